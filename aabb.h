@@ -0,0 +1,92 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "utility.h"
+
+#include <algorithm>
+
+class Aabb {
+public:
+    // An empty box; expanding it by any point or box yields that point or box.
+    Aabb() : minimum(infinity, infinity, infinity), maximum(-infinity, -infinity, -infinity) {}
+    Aabb(const Point3& a, const Point3& b) : minimum(a), maximum(b) {}
+
+    Point3 Min() const { return minimum; }
+    Point3 Max() const { return maximum; }
+
+    Point3 Centroid() const { return Real(0.5) * (minimum + maximum); }
+    Vec3 Extent() const { return maximum - minimum; }
+
+    bool IsEmpty() const {
+        return minimum.x() > maximum.x() || minimum.y() > maximum.y() || minimum.z() > maximum.z();
+    }
+
+    Real SurfaceArea() const {
+        if (IsEmpty())
+            return 0.0;
+        Vec3 d = Extent();
+        return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+    int LongestAxis() const {
+        Vec3 d = Extent();
+        if (d.x() > d.y() && d.x() > d.z()) return 0;
+        return d.y() > d.z() ? 1 : 2;
+    }
+
+    void Expand(const Point3& p) {
+        for (int a = 0; a < 3; a++) {
+            minimum.e[a] = std::min(minimum.e[a], p.e[a]);
+            maximum.e[a] = std::max(maximum.e[a], p.e[a]);
+        }
+    }
+
+    void Expand(const Aabb& box) {
+        for (int a = 0; a < 3; a++) {
+            minimum.e[a] = std::min(minimum.e[a], box.minimum.e[a]);
+            maximum.e[a] = std::max(maximum.e[a], box.maximum.e[a]);
+        }
+    }
+
+    // Grows degenerate (flat) dimensions so that slab tests stay robust.
+    void Pad(Real delta = Real(1e-4)) {
+        for (int a = 0; a < 3; a++) {
+            if (maximum.e[a] - minimum.e[a] < delta) {
+                minimum.e[a] -= delta / 2;
+                maximum.e[a] += delta / 2;
+            }
+        }
+    }
+
+    // Slab test with a precomputed reciprocal ray direction.
+    bool Hit(const Point3& origin, const Vec3& inv_dir, Real t_min, Real t_max) const {
+        for (int a = 0; a < 3; a++) {
+            auto t0 = (minimum.e[a] - origin.e[a]) * inv_dir.e[a];
+            auto t1 = (maximum.e[a] - origin.e[a]) * inv_dir.e[a];
+            if (inv_dir.e[a] < 0.0)
+                std::swap(t0, t1);
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min)
+                return false;
+        }
+        return true;
+    }
+
+    bool Hit(const Ray& r, Real t_min, Real t_max) const {
+        Vec3 d = r.Direction();
+        return Hit(r.Origin(), Vec3(1 / d.x(), 1 / d.y(), 1 / d.z()), t_min, t_max);
+    }
+
+public:
+    Point3 minimum;
+    Point3 maximum;
+};
+
+inline Aabb SurroundingBox(const Aabb& box0, const Aabb& box1) {
+    Aabb box = box0;
+    box.Expand(box1);
+    return box;
+}
+
+#endif // !AABB_H
@@ -0,0 +1,123 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Monotonic arena for scene objects. Objects are constructed in large chunks
+// and only released all at once, by Clear() or the destructor. Each type gets
+// its own chunks, so objects of one type made in a row are laid out
+// contiguously, sizeof(T) apart.
+//
+// Objects that are trivially destructible (Sphere, Triangle, the materials)
+// are never visited again: releasing them costs one free per chunk, whatever
+// their number. Other types are destroyed in reverse order of construction.
+class Arena {
+public:
+    Arena() {}
+    ~Arena() { Clear(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename T, typename... Args>
+    T* Make(Args&&... args);
+
+    // Destroys every object and frees every chunk.
+    void Clear();
+
+    size_t BytesReserved() const { return bytes_reserved_; }
+    size_t BytesUsed() const { return bytes_used_; }
+
+public:
+    static constexpr size_t kFirstChunkBytes = 64 * 1024;
+    static constexpr size_t kMaxChunkBytes = 16 * 1024 * 1024;
+    static constexpr size_t kChunkAlignment = 64;
+
+private:
+    struct Pool {
+        std::vector<std::pair<char*, size_t>> chunks;
+        char* next = nullptr;
+        char* end = nullptr;
+        size_t next_chunk_bytes = kFirstChunkBytes;
+    };
+
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    // Pools are numbered per type, once per process.
+    static size_t NextPoolIndex() {
+        static std::atomic<size_t> next{ 0 };
+        return next++;
+    }
+
+    template <typename T>
+    static size_t PoolIndex() {
+        static const size_t index = NextPoolIndex();
+        return index;
+    }
+
+    void* Allocate(Pool& pool, size_t size, size_t alignment);
+
+private:
+    std::vector<Pool> pools_;
+    std::vector<Destructor> destructors_;
+    size_t bytes_reserved_ = 0;
+    size_t bytes_used_ = 0;
+};
+
+template <typename T, typename... Args>
+T* Arena::Make(Args&&... args) {
+    static_assert(alignof(T) <= kChunkAlignment, "over-aligned type");
+    size_t index = PoolIndex<T>();
+    if (index >= pools_.size())
+        pools_.resize(index + 1);
+
+    T* object = new (Allocate(pools_[index], sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value)
+        destructors_.push_back(Destructor{ object, [](void* p) { static_cast<T*>(p)->~T(); } });
+    return object;
+}
+
+void* Arena::Allocate(Pool& pool, size_t size, size_t alignment) {
+    uintptr_t next = (reinterpret_cast<uintptr_t>(pool.next) + alignment - 1) & ~uintptr_t(alignment - 1);
+    if (!pool.next || next + size > reinterpret_cast<uintptr_t>(pool.end)) {
+        // Chunks double up to kMaxChunkBytes, so a pool holds O(log n) chunks
+        // while it is small and wastes at most one chunk when it is large.
+        size_t bytes = std::max(pool.next_chunk_bytes, size);
+        pool.next_chunk_bytes = std::min(2 * pool.next_chunk_bytes, kMaxChunkBytes);
+        char* chunk = static_cast<char*>(::operator new(bytes, std::align_val_t(kChunkAlignment)));
+        pool.chunks.emplace_back(chunk, bytes);
+        pool.next = chunk;
+        pool.end = chunk + bytes;
+        bytes_reserved_ += bytes;
+        next = reinterpret_cast<uintptr_t>(chunk);
+    }
+    pool.next = reinterpret_cast<char*>(next + size);
+    bytes_used_ += size;
+    return reinterpret_cast<void*>(next);
+}
+
+void Arena::Clear() {
+    for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it)
+        it->destroy(it->object);
+    destructors_.clear();
+
+    for (auto& pool : pools_) {
+        for (auto& chunk : pool.chunks)
+            ::operator delete(chunk.first, std::align_val_t(kChunkAlignment));
+    }
+    pools_.clear();
+    bytes_reserved_ = 0;
+    bytes_used_ = 0;
+}
+
+#endif // !ARENA_H
@@ -0,0 +1,151 @@
+#ifndef ARENA_BENCHMARK_H
+#define ARENA_BENCHMARK_H
+
+#include "utility.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "scene.h"
+#include "sphere.h"
+#include "stopwatch.h"
+#include "triangle.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <unistd.h>
+#endif
+
+// Scene construction with one make_shared per object against the scene
+// arena. Both build the same primitives, alternating spheres and triangles,
+// each with its own Lambertian material as in the random scene, then walk
+// every bounding box once and free everything.
+
+// Resident memory of the process in bytes, or 0 where it is not known.
+inline size_t ResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.WorkingSetSize;
+    return 0;
+#elif defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+struct ConstructionTiming {
+    std::string name;
+    double build_ms = 0.0;
+    double walk_ms = 0.0;
+    double free_ms = 0.0;
+    size_t bytes = 0;
+};
+
+// Builds count primitives into a Container with make_material and make,
+// walks them and destroys the Container, runs times. Times are the fastest of
+// the runs; memory is measured on the first, before freed memory is reused.
+template <typename Container, typename MakeMaterial, typename Make>
+ConstructionTiming TimeConstruction(const std::string& name, size_t count, int runs, MakeMaterial make_material, Make make, double& checksum) {
+    ConstructionTiming timing;
+    timing.name = name;
+    timing.build_ms = timing.walk_ms = timing.free_ms = infinity;
+    for (int run = 0; run < runs; run++) {
+        size_t before = ResidentBytes();
+        SeedRandom(1);
+        StopWatch stop_watch;
+        stop_watch.Begin();
+        auto container = std::make_unique<Container>();
+        for (size_t i = 0; i < count; i++) {
+            Point3 p(Real(RandomDouble(-100, 100)), Real(RandomDouble(-100, 100)), Real(RandomDouble(-100, 100)));
+            auto material = make_material(*container, Color(Real(RandomDouble()), Real(RandomDouble()), Real(RandomDouble())));
+            make(*container, p, material, i % 2 == 0);
+        }
+        timing.build_ms = std::min(timing.build_ms, stop_watch.ElapsedNanoseconds() * 1e-6);
+        size_t after = ResidentBytes();
+        if (run == 0)
+            timing.bytes = after > before ? after - before : 0;
+
+        stop_watch.Begin();
+        for (const auto& object : container->objects.objects) {
+            Aabb box;
+            object->BoundingBox(box);
+            checksum += double(box.Min().x());
+        }
+        timing.walk_ms = std::min(timing.walk_ms, stop_watch.ElapsedNanoseconds() * 1e-6);
+
+        stop_watch.Begin();
+        container.reset();
+        timing.free_ms = std::min(timing.free_ms, stop_watch.ElapsedNanoseconds() * 1e-6);
+    }
+    return timing;
+}
+
+void RunArenaBenchmark(std::ostream& out, size_t count = 10000000, int runs = 3) {
+    struct SharedScene {
+        HittableList objects;
+        std::vector<shared_ptr<Material>> materials;
+    };
+
+    double checksum = 0.0;
+    std::vector<ConstructionTiming> timings;
+
+    // The arena runs first: its chunks go back to the system when it is
+    // freed, while many small allocators keep freed blocks for reuse.
+    timings.push_back(TimeConstruction<Scene>("arena", count, runs,
+        [](Scene& scene, const Color& albedo) { return scene.AddMaterial<Lambertian>(albedo); },
+        [](Scene& scene, const Point3& p, const Lambertian* m, bool sphere) {
+            if (sphere)
+                scene.Emplace<Sphere>(p, Real(0.2), m);
+            else
+                scene.Emplace<Triangle>(p, p + Vec3(0.4, 0, 0), p + Vec3(0, 0.4, 0), m);
+        }, checksum));
+
+    timings.push_back(TimeConstruction<SharedScene>("make_shared", count, runs,
+        [](SharedScene& scene, const Color& albedo) {
+            auto material = make_shared<Lambertian>(albedo);
+            scene.materials.push_back(material);
+            return material.get();
+        },
+        [](SharedScene& scene, const Point3& p, const Lambertian* m, bool sphere) {
+            if (sphere)
+                scene.objects.add(make_shared<Sphere>(p, Real(0.2), m));
+            else
+                scene.objects.add(make_shared<Triangle>(p, p + Vec3(0.4, 0, 0), p + Vec3(0, 0.4, 0), m));
+        }, checksum));
+
+    out << "Scene construction, " << count << " primitives with one material each, best of " << runs << " runs:\n";
+    out << std::fixed << std::setprecision(1);
+    for (const auto& timing : timings) {
+        out << "  " << std::left << std::setw(12) << timing.name << std::right
+            << "  build " << std::setw(8) << timing.build_ms << " ms"
+            << "  walk " << std::setw(7) << timing.walk_ms << " ms"
+            << "  free " << std::setw(7) << timing.free_ms << " ms";
+        if (timing.bytes > 0)
+            out << "  " << std::setw(7) << timing.bytes / (1024.0 * 1024.0) << " MB resident";
+        out << "\n";
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6) << "  (checksum " << checksum << ")\n";
+}
+
+#endif // !ARENA_BENCHMARK_H
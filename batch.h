@@ -0,0 +1,233 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "utility.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "mapped_file.h"
+#include "renderer.h"
+#include "scene_file.h"
+#include "scenes.h"
+#include "stopwatch.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Batch rendering: many frames of one scene, which is loaded and built once.
+// Frames share the thread pool and two framebuffers. While one frame renders,
+// the previous one is written to disk on a separate thread.
+//
+// A batch file lists the frames, one statement per line; # starts a comment:
+//
+//   camera lookfrom 13 2 3 vfov 30   one frame; keys left out keep the previous frame's values
+//   to 24 lookfrom -13 2 3           24 frames moving linearly to this camera, ending on it
+//   orbit 36 360                     36 frames turning lookfrom about lookat and vup, by 360 degrees in all
+//
+// Camera keys are those of scene files (scene_file.h). Statements continue
+// from the last frame, or from the scene's view before the first one. Every
+// frame uses the same seed, so the noise pattern stays fixed on screen.
+
+struct BatchFrameStats {
+    double render_ms = 0.0;
+    double write_ms = 0.0;  // on the writer thread, overlapping the next frame
+    uint64_t rays = 0;
+};
+
+// count frames turning start.lookfrom about the axis through lookat along vup;
+// the last one is turned by degrees.
+std::vector<View> OrbitFrames(const View& start, int count, double degrees) {
+    std::vector<View> frames;
+    Vec3 axis = UnitVector(start.vup);
+    Vec3 offset = start.lookfrom - start.lookat;
+    for (int k = 1; k <= count; k++) {
+        double angle = DegreesToRadians(degrees * k / count);
+        Real c = Real(cos(angle)), s = Real(sin(angle));
+        // Rodrigues' rotation formula.
+        Vec3 turned = c * offset + s * Cross(axis, offset) + (1 - c) * Dot(axis, offset) * axis;
+        View view = start;
+        view.lookfrom = start.lookat + turned;
+        frames.push_back(view);
+    }
+    return frames;
+}
+
+// count frames from just after `from` to `to`, interpolating every parameter linearly.
+std::vector<View> PathFrames(const View& from, const View& to, int count) {
+    std::vector<View> frames;
+    for (int k = 1; k <= count; k++) {
+        double t = double(k) / count;
+        Real rt = Real(t);
+        frames.push_back(View{ from.lookfrom + rt * (to.lookfrom - from.lookfrom), from.lookat + rt * (to.lookat - from.lookat),
+            from.vup + rt * (to.vup - from.vup), from.vfov + t * (to.vfov - from.vfov),
+            from.aperture + t * (to.aperture - from.aperture), from.focus_dist + t * (to.focus_dist - from.focus_dist) });
+    }
+    return frames;
+}
+
+// Appends the frames of the batch file at path to frames, starting from scene_view.
+bool LoadBatchFile(const std::string& path, const View& scene_view, std::vector<View>& frames) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        std::cerr << path << ": cannot open file\n";
+        return false;
+    }
+
+    TextCursor in{ file.Data(), file.Data() + file.Size() };
+    size_t line = 0;
+    auto fail = [&](const std::string& message) {
+        std::cerr << path << ":" << line << ": " << message << "\n";
+        return false;
+    };
+
+    while (in.p < in.end) {
+        line++;
+        if (in.AtLineEnd()) {
+            in.SkipLine();
+            continue;
+        }
+
+        View last = frames.empty() ? scene_view : frames.back();
+        std::string keyword = in.ParseWord();
+        std::string error;
+        if (keyword == "camera") {
+            View view = last;
+            if (!ParseViewKeys(in, view, error))
+                return fail(error);
+            frames.push_back(view);
+        } else if (keyword == "to" || keyword == "orbit") {
+            long count;
+            if (!in.ParseInt(count) || count < 1)
+                return fail("expected a frame count after " + keyword);
+            std::vector<View> added;
+            if (keyword == "to") {
+                View target = last;
+                if (!ParseViewKeys(in, target, error))
+                    return fail(error);
+                added = PathFrames(last, target, static_cast<int>(count));
+            } else {
+                double degrees = 360.0;
+                if (!in.AtLineEnd() && !ParseSceneNumber(in, degrees))
+                    return fail("malformed orbit angle");
+                added = OrbitFrames(last, static_cast<int>(count), degrees);
+            }
+            frames.insert(frames.end(), added.begin(), added.end());
+        } else {
+            return fail("unknown statement " + keyword);
+        }
+
+        if (!in.AtLineEnd())
+            return fail("unexpected text after " + keyword);
+        in.SkipLine();
+    }
+    return true;
+}
+
+// Output path of a frame: a %d in pattern, with an optional zero-padded
+// width such as %04d, becomes the frame number. Without one, _0000 is
+// inserted before the extension.
+std::string FramePath(const std::string& pattern, int frame) {
+    auto number = [frame](int width) {
+        std::ostringstream out;
+        out << std::setw(width) << std::setfill('0') << frame;
+        return out.str();
+    };
+
+    auto percent = pattern.find('%');
+    if (percent != std::string::npos) {
+        size_t end = percent + 1;
+        int width = 0;
+        while (end < pattern.size() && isdigit(static_cast<unsigned char>(pattern[end])))
+            width = width * 10 + (pattern[end++] - '0');
+        if (end < pattern.size() && pattern[end] == 'd')
+            return pattern.substr(0, percent) + number(width) + pattern.substr(end + 1);
+    }
+
+    auto dot = pattern.find_last_of('.');
+    auto slash = pattern.find_last_of("/\\");
+    size_t insert = dot == std::string::npos || (slash != std::string::npos && dot < slash) ? pattern.size() : dot;
+    return pattern.substr(0, insert) + "_" + number(4) + pattern.substr(insert);
+}
+
+// Renders every view in frames and writes frame k to FramePath(output_pattern, k).
+// setup_ms, the time spent loading and building the scene, is only reported:
+// it is what each frame would pay again if it were rendered by its own process.
+bool RenderBatch(const RenderSettings& settings, double aspect_ratio, const Hittable& world, const std::vector<View>& frames,
+    const std::string& output_pattern, ThreadPool& pool, double setup_ms) {
+    RenderSettings frame_settings = settings;
+    frame_settings.progress = false;
+
+    Framebuffer buffers[2] = { Framebuffer(settings.image_width, settings.image_height), Framebuffer(settings.image_width, settings.image_height) };
+    std::future<bool> writes[2];
+    std::vector<BatchFrameStats> stats(frames.size());
+    std::vector<TileStats> tile_stats;
+    bool ok = true;
+
+    StopWatch batch_watch;
+    batch_watch.Begin();
+    size_t rendered = 0;
+    for (; rendered < frames.size(); rendered++) {
+        // Reuse the buffer once the frame it held two frames ago is on disk.
+        int b = static_cast<int>(rendered % 2);
+        if (writes[b].valid() && !writes[b].get()) {
+            ok = false;
+            break;
+        }
+        Framebuffer& framebuffer = buffers[b];
+        framebuffer.Clear();
+
+        StopWatch stop_watch;
+        stop_watch.Begin();
+        Render(frame_settings, world, MakeCamera(frames[rendered], aspect_ratio), pool, framebuffer, tile_stats);
+        BatchFrameStats& frame = stats[rendered];
+        frame.render_ms = stop_watch.ElapsedNanoseconds() * 1e-6;
+        for (const auto& tile : tile_stats)
+            frame.rays += tile.rays;
+
+        std::string path = FramePath(output_pattern, static_cast<int>(rendered));
+        writes[b] = std::async(std::launch::async, [&framebuffer, &frame, &settings, path] {
+            StopWatch write_watch;
+            write_watch.Begin();
+            bool written = WriteImage(path, framebuffer, settings.samples_per_pixel);
+            frame.write_ms = write_watch.ElapsedNanoseconds() * 1e-6;
+            return written;
+        });
+
+        std::cerr << std::fixed << std::setprecision(2) << "Frame " << rendered + 1 << "/" << frames.size() << ": " << frame.render_ms << " ms, "
+                  << frame.rays / (frame.render_ms * 1e3) << " Mrays/s -> " << path << "\n";
+    }
+    for (auto& write : writes) {
+        if (write.valid() && !write.get())
+            ok = false;
+    }
+    double batch_ms = batch_watch.ElapsedNanoseconds() * 1e-6;
+
+    if (rendered > 0) {
+        double render_sum = 0.0, write_sum = 0.0, render_min = infinity, render_max = 0.0;
+        for (size_t f = 0; f < rendered; f++) {
+            render_sum += stats[f].render_ms;
+            write_sum += stats[f].write_ms;
+            render_min = std::min(render_min, stats[f].render_ms);
+            render_max = std::max(render_max, stats[f].render_ms);
+        }
+        double n = static_cast<double>(rendered);
+        std::cerr << "Batch: " << rendered << " frames in " << batch_ms << " ms after " << setup_ms << " ms of setup\n";
+        std::cerr << "  render ms per frame  mean " << render_sum / n << "  min " << render_min << "  max " << render_max << "\n";
+        std::cerr << "  write ms per frame   mean " << write_sum / n << " (overlapped with rendering)\n";
+        std::cerr << "  amortized " << (setup_ms + batch_ms) / n << " ms per frame; one process per frame would take about "
+                  << setup_ms + (render_sum + write_sum) / n << " ms\n";
+        std::cerr.unsetf(std::ios::floatfield);
+        std::cerr << std::setprecision(6);
+    }
+    return ok;
+}
+
+#endif // !BATCH_H
@@ -0,0 +1,233 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "utility.h"
+
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "renderer.h"
+#include "scene.h"
+#include "scenes.h"
+#include "scene_file.h"
+#include "simd.h"
+#include "stopwatch.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Renders the canonical scenes, or scene files, several times and reports
+// per-phase timings:
+//
+//   setup   scene construction or scene file loading, including mesh loading
+//           and per-mesh BVHs
+//   build   the scene's top-level acceleration structure, also per million
+//           primitives
+//   render  Render() over the thread pool
+//   output  encoding the image as binary PPM into memory
+//
+// plus rays and samples per second. Each scene is rebuilt from the same seed
+// on every run, so runs differ only in timing.
+
+struct BenchmarkOptions {
+    int runs = 5;
+    std::vector<std::string> scenes = kCanonicalScenes;
+    std::vector<std::string> mesh_paths;
+    bool use_mapping = true;    // memory-map scene files and the meshes they reference
+    bool use_bvh = true;
+    bool use_sphere_packs = true;
+    BvhBuildOptions bvh;        // the top-level build; its pool is the render pool
+    std::string json_path;      // "-" writes the JSON to std::cout
+};
+
+// Mean, sample standard deviation and range of repeated measurements.
+struct Summary {
+    double mean = 0.0;
+    double stddev = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+};
+
+Summary Summarize(const std::vector<double>& values) {
+    Summary summary;
+    if (values.empty())
+        return summary;
+
+    double sum = 0.0;
+    for (double v : values)
+        sum += v;
+    summary.mean = sum / values.size();
+
+    double squares = 0.0;
+    for (double v : values)
+        squares += (v - summary.mean) * (v - summary.mean);
+    summary.stddev = values.size() > 1 ? std::sqrt(squares / (values.size() - 1)) : 0.0;
+
+    summary.min = *std::min_element(values.begin(), values.end());
+    summary.max = *std::max_element(values.begin(), values.end());
+    return summary;
+}
+
+struct SceneBenchmark {
+    std::string name;
+    size_t objects = 0;
+    size_t lights = 0;
+    size_t bvh_nodes = 0;
+    size_t bvh_primitives = 0;
+    uint64_t rays = 0;          // per run
+    std::vector<double> setup_ns, build_ns, render_ns, output_ns;
+    std::vector<double> build_ms_per_mprim;   // top-level build time per million primitives
+    std::vector<double> rays_per_second, samples_per_second;
+};
+
+void WriteJsonSummary(std::ostream& out, const char* name, const std::vector<double>& values, bool last = false) {
+    Summary s = Summarize(values);
+    out << "      \"" << name << "\": { \"mean\": " << s.mean << ", \"stddev\": " << s.stddev
+        << ", \"min\": " << s.min << ", \"max\": " << s.max << ", \"runs\": [";
+    for (size_t i = 0; i < values.size(); i++)
+        out << (i ? ", " : "") << values[i];
+    out << "] }" << (last ? "\n" : ",\n");
+}
+
+void WriteBenchmarkJson(std::ostream& out, const RenderSettings& settings, int num_threads, const BenchmarkOptions& options,
+    const std::vector<SceneBenchmark>& results) {
+    out << std::setprecision(10);
+    out << "{\n";
+    out << "  \"config\": {\n";
+    out << "    \"precision\": \"" << (sizeof(Real) == sizeof(float) ? "float" : "double") << "\",\n";
+    out << "    \"simd_width\": " << SimdPack<Real>::kWidth << ",\n";
+    out << "    \"threads\": " << num_threads << ",\n";
+    out << "    \"runs\": " << options.runs << ",\n";
+    out << "    \"width\": " << settings.image_width << ",\n";
+    out << "    \"height\": " << settings.image_height << ",\n";
+    out << "    \"samples_per_pixel\": " << settings.samples_per_pixel << ",\n";
+    out << "    \"max_depth\": " << settings.max_depth << ",\n";
+    out << "    \"roulette_depth\": " << settings.roulette_depth << ",\n";
+    out << "    \"tile_size\": " << settings.tile_size << ",\n";
+    out << "    \"seed\": " << settings.seed << ",\n";
+    out << "    \"sampler\": \"" << SamplerName(settings.sampler) << "\",\n";
+    out << "    \"wavefront\": " << (settings.wavefront ? "true" : "false") << ",\n";
+    out << "    \"adaptive\": " << (settings.adaptive ? "true" : "false") << ",\n";
+    out << "    \"noise_threshold\": " << settings.noise_threshold << ",\n";
+    out << "    \"min_samples\": " << settings.min_samples << ",\n";
+    out << "    \"time_budget\": " << settings.time_budget << ",\n";
+    out << "    \"next_event\": " << (settings.next_event ? "true" : "false") << ",\n";
+    out << "    \"bvh\": " << (options.use_bvh ? "true" : "false") << ",\n";
+    out << "    \"sphere_packs\": " << (options.use_sphere_packs ? "true" : "false") << ",\n";
+    out << "    \"bvh_builder\": \"" << BvhBuilderName(options.bvh.builder) << "\",\n";
+    out << "    \"bvh_bins\": " << options.bvh.bins << "\n";
+    out << "  },\n";
+    out << "  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        out << "    {\n";
+        out << "      \"name\": \"" << r.name << "\",\n";
+        out << "      \"objects\": " << r.objects << ",\n";
+        out << "      \"lights\": " << r.lights << ",\n";
+        out << "      \"bvh_nodes\": " << r.bvh_nodes << ",\n";
+        out << "      \"bvh_primitives\": " << r.bvh_primitives << ",\n";
+        out << "      \"rays\": " << r.rays << ",\n";
+        WriteJsonSummary(out, "setup_ns", r.setup_ns);
+        WriteJsonSummary(out, "build_ns", r.build_ns);
+        WriteJsonSummary(out, "build_ms_per_mprim", r.build_ms_per_mprim);
+        WriteJsonSummary(out, "render_ns", r.render_ns);
+        WriteJsonSummary(out, "output_ns", r.output_ns);
+        WriteJsonSummary(out, "rays_per_second", r.rays_per_second);
+        WriteJsonSummary(out, "samples_per_second", r.samples_per_second, true);
+        out << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+bool RunBenchmark(RenderSettings settings, double aspect_ratio, ThreadPool& pool, const BenchmarkOptions& options) {
+    settings.progress = false;
+    std::vector<SceneBenchmark> results;
+
+    for (const auto& name : options.scenes) {
+        SceneBenchmark result;
+        result.name = name;
+
+        for (int run = 0; run < options.runs; run++) {
+            StopWatch stop_watch;
+
+            SeedRandom(settings.seed);
+            stop_watch.Begin();
+            Scene world;
+            View view;
+            if (!BuildScene(name, world, view, options.mesh_paths, nullptr, options.use_mapping))
+                return false;
+            result.setup_ns.push_back(static_cast<double>(stop_watch.ElapsedNanoseconds()));
+
+            stop_watch.Begin();
+            BvhBuildOptions bvh = options.bvh;
+            bvh.pool = &pool;
+            world.Build(options.use_bvh, options.use_sphere_packs, bvh);
+            double build_ns = static_cast<double>(stop_watch.ElapsedNanoseconds());
+            result.build_ns.push_back(build_ns);
+            result.bvh_primitives = world.Accelerator().PrimitiveCount();
+            if (result.bvh_primitives > 0)   // ns per primitive is ms per million
+                result.build_ms_per_mprim.push_back(build_ns / result.bvh_primitives);
+
+            Camera cam = MakeCamera(view, aspect_ratio);
+            Framebuffer framebuffer(settings.image_width, settings.image_height);
+            std::vector<TileStats> tile_stats;
+            settings.lights = &world.Lights();
+            settings.sky = world.sky;
+            stop_watch.Begin();
+            Render(settings, world.Root(), cam, pool, framebuffer, tile_stats);
+            settings.lights = nullptr;
+            double render_ns = static_cast<double>(stop_watch.ElapsedNanoseconds());
+            result.render_ns.push_back(render_ns);
+
+            stop_watch.Begin();
+            std::ostringstream image;
+            WritePpm(image, framebuffer, settings.samples_per_pixel);
+            result.output_ns.push_back(static_cast<double>(stop_watch.ElapsedNanoseconds()));
+
+            result.rays = 0;
+            for (const auto& stats : tile_stats)
+                result.rays += stats.rays;
+            result.rays_per_second.push_back(result.rays / (render_ns * 1e-9));
+            result.samples_per_second.push_back(framebuffer.TotalSamples(settings.samples_per_pixel) / (render_ns * 1e-9));
+            result.objects = world.objects.objects.size();
+            result.lights = world.Lights().Size();
+            result.bvh_nodes = world.Accelerator().NodeCount();
+        }
+
+        Summary render = Summarize(result.render_ns);
+        Summary rays = Summarize(result.rays_per_second);
+        std::cerr << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+                  << " setup " << Summarize(result.setup_ns).mean * 1e-6 << " ms"
+                  << "  build " << Summarize(result.build_ns).mean * 1e-6 << " ms (" << Summarize(result.build_ms_per_mprim).mean << " ms/Mprim)"
+                  << "  render " << render.mean * 1e-6 << " +/- " << render.stddev * 1e-6 << " ms"
+                  << "  output " << Summarize(result.output_ns).mean * 1e-6 << " ms"
+                  << "  " << rays.mean * 1e-6 << " Mrays/s"
+                  << "  " << Summarize(result.samples_per_second).mean * 1e-6 << " Msamples/s\n";
+        std::cerr.unsetf(std::ios::floatfield);
+        std::cerr << std::setprecision(6);
+        results.push_back(result);
+    }
+
+    if (options.json_path.empty())
+        return true;
+    if (options.json_path == "-") {
+        WriteBenchmarkJson(std::cout, settings, pool.NumThreads(), options, results);
+        return true;
+    }
+    std::ofstream json(options.json_path);
+    if (!json) {
+        std::cerr << options.json_path << ": cannot open for writing\n";
+        return false;
+    }
+    WriteBenchmarkJson(json, settings, pool.NumThreads(), options, results);
+    return true;
+}
+
+#endif // !BENCHMARK_H
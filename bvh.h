@@ -0,0 +1,882 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Node of a flattened BVH stored in depth-first order: the left child of an
+// interior node immediately follows it, the right child lives at `offset`.
+struct BvhNode {
+    Aabb box;
+    int offset; // leaf: first primitive, interior: index of the right child
+    int count;  // number of primitives in a leaf, 0 for interior nodes
+    int axis;   // split axis of interior nodes
+};
+
+enum class BvhBuilder {
+    SAH,    // binned surface area heuristic: slower to build, faster to trace
+    LBVH    // splits along sorted Morton codes of the centroids: builds in linear time
+};
+
+// How a BvhTree is built. Fewer SAH bins build faster and trace a little
+// slower; LBVH trades more traversal time for the fastest builds, for
+// scenes rebuilt every frame.
+struct BvhBuildOptions {
+    BvhBuilder builder = BvhBuilder::SAH;
+    int bins = 16;                  // SAH bins per split, 2 to kMaxBins
+    ThreadPool* pool = nullptr;     // builds in parallel when set
+};
+
+const char* BvhBuilderName(BvhBuilder builder) {
+    return builder == BvhBuilder::LBVH ? "lbvh" : "sah";
+}
+
+bool ParseBvhBuilder(const std::string& name, BvhBuilder& builder) {
+    for (BvhBuilder b : { BvhBuilder::SAH, BvhBuilder::LBVH }) {
+        if (name == BvhBuilderName(b)) {
+            builder = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Primitive-agnostic BVH. It is built from primitive bounds alone and reports
+// leaf primitives by position, so owners keep their primitives in whatever
+// container suits them and reorder it once after the build.
+class BvhTree {
+public:
+    // Builds the tree and returns the primitive order the leaves refer to:
+    // leaf primitives are order[offset], ..., order[offset + count - 1].
+    // With a pool, the top levels are split with parallel scans and the
+    // subtrees below them are built as parallel tasks. The tree does not
+    // depend on the thread count.
+    std::vector<int> Build(const std::vector<Aabb>& boxes, const BvhBuildOptions& options = BvhBuildOptions());
+
+    // Walks the tree front to back. intersect(position, t_min, t_max) tests one
+    // primitive, shrinks t_max to the hit distance and returns true on a hit.
+    template <typename IntersectFn>
+    bool Intersect(const Ray& r, Real t_min, Real t_max, IntersectFn&& intersect) const;
+
+    // Any-hit walk: occluded(position, t_min, t_max) tests one primitive and
+    // returns true if it blocks the ray, which ends the walk.
+    template <typename OccludedFn>
+    bool Occluded(const Ray& r, Real t_min, Real t_max, OccludedFn&& occluded) const;
+
+    // Walks the tree once for a packet of up to kMaxPacketSize rays, testing
+    // each node box against all of them SIMD-wide. intersect(ray, position,
+    // t_min, t_max) is called for the rays that reach a leaf; t_max[k] holds
+    // the closest hit distance of ray k.
+    static constexpr int kMaxPacketSize = 64;
+    template <typename IntersectFn>
+    void IntersectPacket(const Ray* rays, int count, Real t_min, Real* t_max, IntersectFn&& intersect) const;
+
+    // Adopts nodes saved from an earlier build over primitive_count
+    // primitives. Their boxes are not trusted; call Refit() next. Returns
+    // false, leaving the tree empty, if the nodes do not form a valid tree.
+    bool Adopt(std::vector<BvhNode> saved, int primitive_count);
+
+    // Recomputes every node box bottom up from the primitive boxes, given in
+    // leaf order, keeping the topology.
+    void Refit(const std::vector<Aabb>& boxes);
+
+    // Expected cost of a random ray under the surface area heuristic, in
+    // units of one primitive test; lower traces faster.
+    double SahCost() const;
+
+    bool Empty() const { return nodes.empty(); }
+    Aabb Bounds() const { return nodes.empty() ? Aabb() : nodes[0].box; }
+
+public:
+    std::vector<BvhNode> nodes;
+
+    static constexpr int kMaxBins = 64;
+
+private:
+    struct BuildPrimitive {
+        Aabb box;
+        Point3 centroid;
+        int index;
+    };
+
+    // A subtree left for a parallel task; its place in the top levels is
+    // held by a node with count -1 and offset set to the task number.
+    struct BuildTask {
+        int begin, end, depth;
+    };
+
+    struct BuildState {
+        BvhBuildOptions options;
+        std::vector<BuildPrimitive> prims;
+        std::vector<BuildPrimitive> scratch;    // partition target of the parallel scans
+        std::vector<uint32_t> codes;            // LBVH: Morton code of prims[i], sorted
+        int task_size = 0;                      // top-level ranges up to this size become tasks
+        std::vector<BuildTask> tasks;
+    };
+
+    static const int kMaxLeafSize = 4;
+    static const int kMaxDepth = 60; // keeps traversal inside its fixed stack
+    static constexpr double kTraversalCost = 1.0;
+    static const int kParallelScanSize = 1 << 15;  // smallest range scanned in parallel
+    static constexpr int kMinTaskSize = 1 << 10;
+
+    // top is true in the serial top levels, which may scan in parallel and
+    // hand subtrees out as tasks; tasks build with top false.
+    int BuildNode(BuildState& state, std::vector<BvhNode>& out, int begin, int end, int depth, bool top);
+    int BuildSahNode(BuildState& state, std::vector<BvhNode>& out, int begin, int end, int depth, bool top);
+    int BuildLbvhNode(BuildState& state, std::vector<BvhNode>& out, int begin, int end, int depth, bool top);
+    static int MakeLeaf(std::vector<BvhNode>& out, const Aabb& bounds, int begin, int end);
+    void SortByMortonCode(BuildState& state);
+    // Copies the top levels into nodes depth first, splicing in the task subtrees.
+    int Splice(const std::vector<BvhNode>& top, int index, std::vector<std::vector<BvhNode>>& parts);
+
+    // Calls fn(chunk, begin, end) over [begin, end) cut in chunks, on the
+    // pool when the range is large enough, and returns the chunk count.
+    template <typename Fn>
+    static int ForChunks(ThreadPool* pool, int begin, int end, Fn&& fn);
+};
+
+template <typename Fn>
+int BvhTree::ForChunks(ThreadPool* pool, int begin, int end, Fn&& fn) {
+    int count = end - begin;
+    int chunks = pool && pool->NumThreads() > 1 && count >= kParallelScanSize ? 4 * pool->NumThreads() : 1;
+    if (chunks == 1) {
+        fn(0, begin, end);
+        return 1;
+    }
+    pool->ParallelFor(chunks, [&](int chunk, int) {
+        fn(chunk, begin + static_cast<int>(int64_t(count) * chunk / chunks), begin + static_cast<int>(int64_t(count) * (chunk + 1) / chunks));
+    });
+    return chunks;
+}
+
+std::vector<int> BvhTree::Build(const std::vector<Aabb>& boxes, const BvhBuildOptions& options) {
+    nodes.clear();
+    std::vector<int> order;
+    if (boxes.empty())
+        return order;
+
+    BuildState state;
+    state.options = options;
+    state.options.bins = std::max(2, std::min(options.bins, kMaxBins));
+    int n = static_cast<int>(boxes.size());
+    ThreadPool* pool = options.pool;
+    int threads = pool ? pool->NumThreads() : 1;
+    if (threads > 1 && n >= 2 * kMinTaskSize)
+        state.task_size = std::max(kMinTaskSize, n / (8 * threads));
+
+    state.prims.resize(boxes.size());
+    ForChunks(pool, 0, n, [&](int, int begin, int end) {
+        for (int i = begin; i < end; i++)
+            state.prims[i] = BuildPrimitive{ boxes[i], boxes[i].Centroid(), i };
+    });
+    if (state.options.builder == BvhBuilder::LBVH)
+        SortByMortonCode(state);
+    else if (state.task_size > 0)
+        state.scratch.resize(state.prims.size());
+
+    if (state.task_size == 0) {
+        nodes.reserve(2 * boxes.size());
+        BuildNode(state, nodes, 0, n, 0, true);
+    } else {
+        std::vector<BvhNode> top;
+        BuildNode(state, top, 0, n, 0, true);
+        std::vector<std::vector<BvhNode>> parts(state.tasks.size());
+        pool->ParallelFor(static_cast<int>(state.tasks.size()), [&](int t, int) {
+            const BuildTask& task = state.tasks[t];
+            parts[t].reserve(2 * (task.end - task.begin));
+            BuildNode(state, parts[t], task.begin, task.end, task.depth, false);
+        });
+        nodes.reserve(2 * boxes.size());
+        Splice(top, 0, parts);
+    }
+
+    // LBVH splits without looking at bounds; interior boxes are filled in here.
+    if (state.options.builder == BvhBuilder::LBVH) {
+        for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--) {
+            BvhNode& node = nodes[i];
+            if (node.count == 0) {
+                node.box = nodes[i + 1].box;
+                node.box.Expand(nodes[node.offset].box);
+            }
+        }
+    }
+
+    order.resize(state.prims.size());
+    for (size_t i = 0; i < state.prims.size(); i++)
+        order[i] = state.prims[i].index;
+    return order;
+}
+
+int BvhTree::Splice(const std::vector<BvhNode>& top, int index, std::vector<std::vector<BvhNode>>& parts) {
+    BvhNode node = top[index];
+    int placed = static_cast<int>(nodes.size());
+    if (node.count < 0) {
+        for (BvhNode sub : parts[node.offset]) {
+            if (sub.count == 0)
+                sub.offset += placed;
+            nodes.push_back(sub);
+        }
+        std::vector<BvhNode>().swap(parts[node.offset]);
+        return placed;
+    }
+
+    nodes.push_back(node);
+    if (node.count > 0)
+        return placed;
+    Splice(top, index + 1, parts);
+    nodes[placed].offset = Splice(top, node.offset, parts);
+    return placed;
+}
+
+int BvhTree::MakeLeaf(std::vector<BvhNode>& out, const Aabb& bounds, int begin, int end) {
+    out.push_back(BvhNode{ bounds, begin, end - begin, 0 });
+    return static_cast<int>(out.size()) - 1;
+}
+
+int BvhTree::BuildNode(BuildState& state, std::vector<BvhNode>& out, int begin, int end, int depth, bool top) {
+    if (top && end - begin <= state.task_size) {
+        out.push_back(BvhNode{ Aabb(), static_cast<int>(state.tasks.size()), -1, 0 });
+        state.tasks.push_back(BuildTask{ begin, end, depth });
+        return static_cast<int>(out.size()) - 1;
+    }
+    if (state.options.builder == BvhBuilder::LBVH)
+        return BuildLbvhNode(state, out, begin, end, depth, top);
+    return BuildSahNode(state, out, begin, end, depth, top);
+}
+
+int BvhTree::BuildSahNode(BuildState& state, std::vector<BvhNode>& out, int begin, int end, int depth, bool top) {
+    std::vector<BuildPrimitive>& prims = state.prims;
+    ThreadPool* pool = top ? state.options.pool : nullptr;
+    const int kBins = state.options.bins;
+
+    // Per-chunk results are merged in chunk order. Box unions and counts are
+    // exact, so the split does not depend on how the range was cut.
+    const int max_chunks = pool ? 4 * pool->NumThreads() : 1;
+    std::vector<Aabb> chunk_bounds(max_chunks), chunk_centroids(max_chunks);
+    int chunks = ForChunks(pool, begin, end, [&](int chunk, int b, int e) {
+        for (int i = b; i < e; i++) {
+            chunk_bounds[chunk].Expand(prims[i].box);
+            chunk_centroids[chunk].Expand(prims[i].centroid);
+        }
+    });
+    Aabb bounds, centroid_bounds;
+    for (int c = 0; c < chunks; c++) {
+        bounds.Expand(chunk_bounds[c]);
+        centroid_bounds.Expand(chunk_centroids[c]);
+    }
+
+    int count = end - begin;
+    if (count == 1 || depth >= kMaxDepth)
+        return MakeLeaf(out, bounds, begin, end);
+
+    int axis = centroid_bounds.LongestAxis();
+    Real axis_min = centroid_bounds.Min()[axis];
+    Real axis_extent = centroid_bounds.Max()[axis] - axis_min;
+    if (axis_extent <= 0.0)
+        return MakeLeaf(out, bounds, begin, end);
+
+    // Bin the centroids and evaluate the surface area heuristic at every bin boundary.
+    struct Bin {
+        Aabb box;
+        int count = 0;
+    };
+
+    auto bin_of = [&](const BuildPrimitive& prim) {
+        int b = static_cast<int>(kBins * (prim.centroid[axis] - axis_min) / axis_extent);
+        return std::min(b, kBins - 1);
+    };
+
+    std::vector<Bin> chunk_bins(static_cast<size_t>(max_chunks) * kBins);
+    ForChunks(pool, begin, end, [&](int chunk, int b, int e) {
+        Bin* local = &chunk_bins[static_cast<size_t>(chunk) * kBins];
+        for (int i = b; i < e; i++) {
+            auto& bin = local[bin_of(prims[i])];
+            bin.box.Expand(prims[i].box);
+            bin.count++;
+        }
+    });
+    Bin bins[kMaxBins];
+    for (int c = 0; c < chunks; c++) {
+        for (int b = 0; b < kBins; b++) {
+            bins[b].box.Expand(chunk_bins[static_cast<size_t>(c) * kBins + b].box);
+            bins[b].count += chunk_bins[static_cast<size_t>(c) * kBins + b].count;
+        }
+    }
+
+    double right_area[kMaxBins];
+    int right_count[kMaxBins];
+    Aabb sweep;
+    int sweep_count = 0;
+    for (int b = kBins - 1; b > 0; b--) {
+        sweep.Expand(bins[b].box);
+        sweep_count += bins[b].count;
+        right_area[b] = sweep.SurfaceArea();
+        right_count[b] = sweep_count;
+    }
+
+    int best_split = -1;
+    double best_cost = infinity;
+    sweep = Aabb();
+    sweep_count = 0;
+    for (int b = 0; b < kBins - 1; b++) {
+        sweep.Expand(bins[b].box);
+        sweep_count += bins[b].count;
+        if (sweep_count == 0 || right_count[b + 1] == 0)
+            continue;
+        double cost = sweep.SurfaceArea() * sweep_count + right_area[b + 1] * right_count[b + 1];
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_split = b;
+        }
+    }
+
+    double parent_area = bounds.SurfaceArea();
+    double split_cost = parent_area > 0.0 ? kTraversalCost + best_cost / parent_area : infinity;
+    if (count <= kMaxLeafSize && split_cost >= count)
+        return MakeLeaf(out, bounds, begin, end);
+
+    int mid;
+    if (best_split >= 0) {
+        // Stable, so the leaf order is the same whether or not the range is
+        // partitioned in parallel.
+        auto left = [&](const BuildPrimitive& prim) { return bin_of(prim) <= best_split; };
+        if (chunks == 1) {
+            auto it = std::stable_partition(prims.begin() + begin, prims.begin() + end, left);
+            mid = static_cast<int>(it - prims.begin());
+        } else {
+            // Count each chunk's left side, then scatter every chunk into place
+            // through the scratch buffer.
+            std::vector<int> left_counts(chunks, 0);
+            ForChunks(pool, begin, end, [&](int chunk, int b, int e) {
+                for (int i = b; i < e; i++)
+                    left_counts[chunk] += left(prims[i]) ? 1 : 0;
+            });
+            // Chunk c's left side goes after the left sides of the chunks
+            // before it, and likewise for the right sides after mid.
+            std::vector<int> left_at(chunks), right_at(chunks);
+            int total_left = 0;
+            for (int c = 0; c < chunks; c++) {
+                left_at[c] = begin + total_left;
+                total_left += left_counts[c];
+            }
+            mid = begin + total_left;
+            int right_before = 0;
+            for (int c = 0; c < chunks; c++) {
+                int chunk_size = static_cast<int>(int64_t(count) * (c + 1) / chunks - int64_t(count) * c / chunks);
+                right_at[c] = mid + right_before;
+                right_before += chunk_size - left_counts[c];
+            }
+            ForChunks(pool, begin, end, [&](int chunk, int b, int e) {
+                int l = left_at[chunk], r = right_at[chunk];
+                for (int i = b; i < e; i++)
+                    state.scratch[left(prims[i]) ? l++ : r++] = prims[i];
+            });
+            ForChunks(pool, begin, end, [&](int, int b, int e) {
+                std::copy(state.scratch.begin() + b, state.scratch.begin() + e, prims.begin() + b);
+            });
+        }
+    } else {
+        mid = begin + count / 2;
+        std::nth_element(prims.begin() + begin, prims.begin() + mid, prims.begin() + end,
+            [axis](const BuildPrimitive& a, const BuildPrimitive& b) { return a.centroid[axis] < b.centroid[axis]; });
+    }
+
+    int node_index = static_cast<int>(out.size());
+    out.push_back(BvhNode{ bounds, 0, 0, axis });
+
+    BuildNode(state, out, begin, mid, depth + 1, top);
+    int right = BuildNode(state, out, mid, end, depth + 1, top);
+    out[node_index].offset = right;
+    return node_index;
+}
+// Spreads the low 10 bits of v so that two zero bits follow each one.
+inline uint32_t SpreadBits3(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+void BvhTree::SortByMortonCode(BuildState& state) {
+    ThreadPool* pool = state.options.pool;
+    int n = static_cast<int>(state.prims.size());
+    const int max_chunks = pool ? 4 * pool->NumThreads() : 1;
+
+    std::vector<Aabb> chunk_centroids(max_chunks);
+    int chunks = ForChunks(pool, 0, n, [&](int chunk, int b, int e) {
+        for (int i = b; i < e; i++)
+            chunk_centroids[chunk].Expand(state.prims[i].centroid);
+    });
+    Aabb centroid_bounds;
+    for (int c = 0; c < chunks; c++)
+        centroid_bounds.Expand(chunk_centroids[c]);
+
+    // 30-bit codes, x in the highest bit of every triple. The key keeps the
+    // primitive's position below the code, so equal codes stay in input order.
+    Point3 lo = centroid_bounds.Min();
+    Vec3 extent = centroid_bounds.Extent();
+    std::vector<uint64_t> keys(n), sorted(n);
+    ForChunks(pool, 0, n, [&](int, int b, int e) {
+        for (int i = b; i < e; i++) {
+            uint32_t q[3];
+            for (int a = 0; a < 3; a++) {
+                Real t = extent[a] > 0 ? (state.prims[i].centroid[a] - lo[a]) / extent[a] : Real(0);
+                q[a] = static_cast<uint32_t>(std::min(Real(1023), std::max(Real(0), t * 1024)));
+            }
+            uint32_t code = (SpreadBits3(q[0]) << 2) | (SpreadBits3(q[1]) << 1) | SpreadBits3(q[2]);
+            keys[i] = (uint64_t(code) << 32) | uint32_t(i);
+        }
+    });
+
+    // LSD radix sort on the code, 10 bits per pass: per-chunk histograms,
+    // then every chunk scatters its keys in order, which keeps the sort stable.
+    const int kRadix = 1 << 10;
+    std::vector<int> counts(static_cast<size_t>(max_chunks) * kRadix);
+    for (int shift = 32; shift < 62; shift += 10) {
+        std::fill(counts.begin(), counts.end(), 0);
+        ForChunks(pool, 0, n, [&](int chunk, int b, int e) {
+            int* local = &counts[static_cast<size_t>(chunk) * kRadix];
+            for (int i = b; i < e; i++)
+                local[(keys[i] >> shift) & (kRadix - 1)]++;
+        });
+        int sum = 0;
+        for (int digit = 0; digit < kRadix; digit++) {
+            for (int c = 0; c < chunks; c++) {
+                int& slot = counts[static_cast<size_t>(c) * kRadix + digit];
+                int k = slot;
+                slot = sum;
+                sum += k;
+            }
+        }
+        ForChunks(pool, 0, n, [&](int chunk, int b, int e) {
+            int* local = &counts[static_cast<size_t>(chunk) * kRadix];
+            for (int i = b; i < e; i++)
+                sorted[local[(keys[i] >> shift) & (kRadix - 1)]++] = keys[i];
+        });
+        keys.swap(sorted);
+    }
+
+    std::vector<BuildPrimitive> prims(n);
+    state.codes.resize(n);
+    ForChunks(pool, 0, n, [&](int, int b, int e) {
+        for (int i = b; i < e; i++) {
+            prims[i] = state.prims[keys[i] & 0xffffffffu];
+            state.codes[i] = static_cast<uint32_t>(keys[i] >> 32);
+        }
+    });
+    state.prims.swap(prims);
+}
+
+int BvhTree::BuildLbvhNode(BuildState& state, std::vector<BvhNode>& out, int begin, int end, int depth, bool top) {
+    int count = end - begin;
+    if (count <= kMaxLeafSize || depth >= kMaxDepth) {
+        Aabb bounds;
+        for (int i = begin; i < end; i++)
+            bounds.Expand(state.prims[i].box);
+        return MakeLeaf(out, bounds, begin, end);
+    }
+
+    // Split where the highest bit that differs across the range turns to one.
+    // Codes that are all equal split in the middle.
+    uint32_t first = state.codes[begin], last = state.codes[end - 1];
+    int mid = begin + count / 2;
+    int axis = 0;
+    if (first != last) {
+        int bit = 31;
+        while (!((first ^ last) >> bit & 1))
+            bit--;
+        mid = static_cast<int>(std::partition_point(state.codes.begin() + begin, state.codes.begin() + end,
+            [bit](uint32_t code) { return !(code >> bit & 1); }) - state.codes.begin());
+        axis = 2 - bit % 3;
+    }
+
+    // The box is filled in once the whole tree is built.
+    int node_index = static_cast<int>(out.size());
+    out.push_back(BvhNode{ Aabb(), 0, 0, axis });
+    BuildNode(state, out, begin, mid, depth + 1, top);
+    int right = BuildNode(state, out, mid, end, depth + 1, top);
+    out[node_index].offset = right;
+    return node_index;
+}
+
+double BvhTree::SahCost() const {
+    if (nodes.empty())
+        return 0.0;
+    double root_area = nodes[0].box.SurfaceArea();
+    if (root_area <= 0.0)
+        return 0.0;
+    double cost = 0.0;
+    for (const auto& node : nodes)
+        cost += node.box.SurfaceArea() / root_area * (node.count > 0 ? node.count : kTraversalCost);
+    return cost;
+}
+
+bool BvhTree::Adopt(std::vector<BvhNode> saved, int primitive_count) {
+    nodes.clear();
+    int n = static_cast<int>(saved.size());
+    if (n == 0)
+        return primitive_count == 0;
+
+    // Children follow their parent, the left one immediately, so one forward
+    // pass checks the links and the depth the traversal stacks allow.
+    std::vector<int> depth(n, 0);
+    for (int i = 0; i < n; i++) {
+        const BvhNode& node = saved[i];
+        if (node.count > 0) {
+            if (node.offset < 0 || node.offset > primitive_count - node.count)
+                return false;
+            continue;
+        }
+        if (node.count < 0 || node.offset <= i + 1 || node.offset >= n || node.axis < 0 || node.axis > 2)
+            return false;
+        for (int child : { i + 1, node.offset }) {
+            depth[child] = std::max(depth[child], depth[i] + 1);
+            if (depth[child] > kMaxDepth)
+                return false;
+        }
+    }
+    nodes = std::move(saved);
+    return true;
+}
+
+void BvhTree::Refit(const std::vector<Aabb>& boxes) {
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--) {
+        BvhNode& node = nodes[i];
+        Aabb box;
+        if (node.count > 0) {
+            for (int k = node.offset; k < node.offset + node.count; k++)
+                box.Expand(boxes[k]);
+        } else {
+            box.Expand(nodes[i + 1].box);
+            box.Expand(nodes[node.offset].box);
+        }
+        node.box = box;
+    }
+}
+
+template <typename IntersectFn>
+bool BvhTree::Intersect(const Ray& r, Real t_min, Real t_max, IntersectFn&& intersect) const {
+    if (nodes.empty())
+        return false;
+
+    Point3 origin = r.Origin();
+    Vec3 dir = r.Direction();
+    Vec3 inv_dir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+    bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+    int stack[kMaxDepth + 4];
+    int stack_size = 0;
+    int node_index = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const BvhNode& node = nodes[node_index];
+        STATS_INC(bvh_nodes);
+        if (node.box.Hit(origin, inv_dir, t_min, t_max)) {
+            if (node.count > 0) {
+                for (int i = node.offset; i < node.offset + node.count; i++) {
+                    if (intersect(i, t_min, t_max))
+                        hit_anything = true;
+                }
+            } else {
+                // Visit the child nearer to the ray origin first so t_max shrinks early.
+                if (dir_is_neg[node.axis]) {
+                    stack[stack_size++] = node_index + 1;
+                    node_index = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    node_index = node_index + 1;
+                }
+                continue;
+            }
+        }
+        if (stack_size == 0)
+            break;
+        node_index = stack[--stack_size];
+    }
+
+    return hit_anything;
+}
+
+template <typename OccludedFn>
+bool BvhTree::Occluded(const Ray& r, Real t_min, Real t_max, OccludedFn&& occluded) const {
+    if (nodes.empty())
+        return false;
+
+    Point3 origin = r.Origin();
+    Vec3 dir = r.Direction();
+    Vec3 inv_dir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+    bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+    int stack[kMaxDepth + 4];
+    int stack_size = 0;
+    int node_index = 0;
+
+    while (true) {
+        const BvhNode& node = nodes[node_index];
+        STATS_INC(bvh_nodes);
+        if (node.box.Hit(origin, inv_dir, t_min, t_max)) {
+            if (node.count > 0) {
+                for (int i = node.offset; i < node.offset + node.count; i++) {
+                    if (occluded(i, t_min, t_max))
+                        return true;
+                }
+            } else {
+                // t_max never shrinks, so the order only decides which
+                // blocker is found first; near first still tends to be sooner.
+                if (dir_is_neg[node.axis]) {
+                    stack[stack_size++] = node_index + 1;
+                    node_index = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    node_index = node_index + 1;
+                }
+                continue;
+            }
+        }
+        if (stack_size == 0)
+            break;
+        node_index = stack[--stack_size];
+    }
+
+    return false;
+}
+
+template <typename IntersectFn>
+void BvhTree::IntersectPacket(const Ray* rays, int count, Real t_min, Real* t_max, IntersectFn&& intersect) const {
+    using Pack = SimdPack<Real>;
+    if (nodes.empty() || count <= 0)
+        return;
+
+    // Packet in structure-of-arrays form, padded to whole SIMD widths with
+    // lanes whose empty interval never hits.
+    alignas(64) Real ox[kMaxPacketSize], oy[kMaxPacketSize], oz[kMaxPacketSize];
+    alignas(64) Real ix[kMaxPacketSize], iy[kMaxPacketSize], iz[kMaxPacketSize];
+    alignas(64) Real t_far[kMaxPacketSize], lane_hit[kMaxPacketSize];
+    int padded = (count + Pack::kWidth - 1) / Pack::kWidth * Pack::kWidth;
+    for (int k = 0; k < padded; k++) {
+        if (k < count) {
+            const Ray& r = rays[k];
+            ox[k] = r.orig.x(); oy[k] = r.orig.y(); oz[k] = r.orig.z();
+            ix[k] = 1 / r.dir.x(); iy[k] = 1 / r.dir.y(); iz[k] = 1 / r.dir.z();
+            t_far[k] = t_max[k];
+        } else {
+            ox[k] = oy[k] = oz[k] = 0;
+            ix[k] = iy[k] = iz[k] = 1;
+            t_far[k] = -infinity;
+        }
+    }
+
+    // Coherent packets share a direction octant; order children by the first ray.
+    bool dir_is_neg[3] = { ix[0] < 0, iy[0] < 0, iz[0] < 0 };
+    const Real* origins[3] = { ox, oy, oz };
+    const Real* inv_dirs[3] = { ix, iy, iz };
+    const Pack zero = Pack::Set1(0), one = Pack::Set1(1), lo = Pack::Set1(t_min);
+
+    int stack[kMaxDepth + 4];
+    int stack_size = 0;
+    int node_index = 0;
+
+    while (true) {
+        const BvhNode& node = nodes[node_index];
+        STATS_INC(bvh_nodes);
+
+        // Same slab test as Aabb::Hit, one ray per lane.
+        bool any = false;
+        for (int h = 0; h < padded; h += Pack::kWidth) {
+            Pack near_t = lo, far_t = Pack::Load(t_far + h);
+            for (int a = 0; a < 3; a++) {
+                Pack o = Pack::Load(origins[a] + h), inv = Pack::Load(inv_dirs[a] + h);
+                Pack t0 = (Pack::Set1(node.box.minimum[a]) - o) * inv;
+                Pack t1 = (Pack::Set1(node.box.maximum[a]) - o) * inv;
+                auto neg = Pack::CmpLe(inv, zero);
+                Pack enter = Pack::Select(neg, t1, t0), exit = Pack::Select(neg, t0, t1);
+                near_t = Pack::Select(Pack::CmpGe(enter, near_t), enter, near_t);
+                far_t = Pack::Select(Pack::CmpLe(exit, far_t), exit, far_t);
+            }
+            auto hit = Pack::CmpLe(near_t, far_t);
+            any = any || Pack::Any(hit);
+            Pack::Select(hit, one, zero).Store(lane_hit + h);
+        }
+
+        if (any) {
+            if (node.count > 0) {
+                for (int k = 0; k < count; k++) {
+                    if (lane_hit[k] == 0)
+                        continue;
+                    for (int i = node.offset; i < node.offset + node.count; i++)
+                        intersect(k, i, t_min, t_far[k]);
+                }
+            } else {
+                if (dir_is_neg[node.axis]) {
+                    stack[stack_size++] = node_index + 1;
+                    node_index = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    node_index = node_index + 1;
+                }
+                continue;
+            }
+        }
+        if (stack_size == 0)
+            break;
+        node_index = stack[--stack_size];
+    }
+
+    for (int k = 0; k < count; k++)
+        t_max[k] = t_far[k];
+}
+
+// Bounding volume hierarchy over the objects of a HittableList.
+class Bvh : public Hittable {
+public:
+    Bvh() {}
+    Bvh(const HittableList& list) { Build(list.objects); }
+
+    void Build(const std::vector<shared_ptr<Hittable>>& objects, const BvhBuildOptions& options = BvhBuildOptions());
+
+    // Updates the node boxes after objects moved or changed shape, keeping the
+    // tree: much faster than Build(), but traversal degrades as the objects
+    // drift from where they were at the build. Objects cannot join or leave.
+    void Refit(ThreadPool* pool = nullptr);
+
+    virtual bool Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override;
+    virtual void HitPacket(const Ray* rays, int count, Real t_min, Real t_max, HitRecord* recs, bool* hits) const override;
+    virtual bool Occluded(const Ray& r, Real t_min, Real t_max) const override;
+    virtual bool BoundingBox(Aabb& output_box) const override;
+
+    size_t PrimitiveCount() const { return objects_.size() + unbounded_.size(); }
+    size_t NodeCount() const { return tree_.nodes.size(); }
+    const BvhTree& Tree() const { return tree_; }
+
+private:
+    std::vector<shared_ptr<Hittable>> objects_;   // in leaf order
+    std::vector<shared_ptr<Hittable>> unbounded_; // objects without finite bounds, tested linearly
+    BvhTree tree_;
+};
+
+void Bvh::Build(const std::vector<shared_ptr<Hittable>>& objects, const BvhBuildOptions& options) {
+    std::vector<shared_ptr<Hittable>> bounded;
+    std::vector<Aabb> boxes;
+    unbounded_.clear();
+
+    Aabb box;
+    for (const auto& object : objects) {
+        if (object->BoundingBox(box)) {
+            bounded.push_back(object);
+            boxes.push_back(box);
+        } else {
+            unbounded_.push_back(object);
+        }
+    }
+
+    auto order = tree_.Build(boxes, options);
+    objects_.clear();
+    objects_.reserve(order.size());
+    for (int index : order)
+        objects_.push_back(bounded[index]);
+
+    // Group each leaf's objects by type, so HitPrimitive takes the same branch
+    // for runs of them.
+    for (const auto& node : tree_.nodes) {
+        if (node.count > 1) {
+            std::stable_sort(objects_.begin() + node.offset, objects_.begin() + node.offset + node.count,
+                [](const shared_ptr<Hittable>& a, const shared_ptr<Hittable>& b) { return a->type_ < b->type_; });
+        }
+    }
+}
+
+void Bvh::Refit(ThreadPool* pool) {
+    std::vector<Aabb> boxes(objects_.size());
+    auto refit_chunk = [&](int chunk, int chunks) {
+        size_t begin = boxes.size() * chunk / chunks, end = boxes.size() * (chunk + 1) / chunks;
+        for (size_t i = begin; i < end; i++) {
+            if (!objects_[i]->BoundingBox(boxes[i]))
+                boxes[i] = Aabb();
+        }
+    };
+    if (pool && pool->NumThreads() > 1)
+        pool->ParallelFor(4 * pool->NumThreads(), [&](int chunk, int) { refit_chunk(chunk, 4 * pool->NumThreads()); });
+    else
+        refit_chunk(0, 1);
+    tree_.Refit(boxes);
+}
+
+bool Bvh::Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
+    bool hit_anything = false;
+
+    // Hittables only touch rec on a hit closer than t_max, so it can be filled in place.
+    for (const auto& object : unbounded_) {
+        if (HitPrimitive(*object, r, t_min, t_max, rec)) {
+            hit_anything = true;
+            t_max = rec.t;
+        }
+    }
+
+    if (tree_.Intersect(r, t_min, t_max, [&](int i, Real t_lo, Real& t_hi) {
+            if (!HitPrimitive(*objects_[i], r, t_lo, t_hi, rec))
+                return false;
+            t_hi = rec.t;
+            return true;
+        }))
+        hit_anything = true;
+
+    return hit_anything;
+}
+
+void Bvh::HitPacket(const Ray* rays, int count, Real t_min, Real t_max, HitRecord* recs, bool* hits) const {
+    Real t_hit[BvhTree::kMaxPacketSize];
+
+    for (int first = 0; first < count; first += BvhTree::kMaxPacketSize) {
+        int size = std::min(count - first, BvhTree::kMaxPacketSize);
+        const Ray* packet = rays + first;
+
+        for (int k = 0; k < size; k++) {
+            hits[first + k] = false;
+            t_hit[k] = t_max;
+            for (const auto& object : unbounded_) {
+                if (HitPrimitive(*object, packet[k], t_min, t_hit[k], recs[first + k])) {
+                    hits[first + k] = true;
+                    t_hit[k] = recs[first + k].t;
+                }
+            }
+        }
+
+        tree_.IntersectPacket(packet, size, t_min, t_hit, [&](int k, int i, Real t_lo, Real& t_hi) {
+            if (!HitPrimitive(*objects_[i], packet[k], t_lo, t_hi, recs[first + k]))
+                return;
+            t_hi = recs[first + k].t;
+            hits[first + k] = true;
+        });
+    }
+}
+
+bool Bvh::Occluded(const Ray& r, Real t_min, Real t_max) const {
+    for (const auto& object : unbounded_) {
+        if (OccludedPrimitive(*object, r, t_min, t_max))
+            return true;
+    }
+    return tree_.Occluded(r, t_min, t_max, [&](int i, Real t_lo, Real t_hi) {
+        return OccludedPrimitive(*objects_[i], r, t_lo, t_hi);
+    });
+}
+
+bool Bvh::BoundingBox(Aabb& output_box) const {
+    if (!unbounded_.empty() || tree_.Empty())
+        return false;
+    output_box = tree_.Bounds();
+    return true;
+}
+
+#endif // !BVH_H
@@ -0,0 +1,185 @@
+#ifndef BVH_BENCHMARK_H
+#define BVH_BENCHMARK_H
+
+#include "utility.h"
+#include "bvh.h"
+#include "stopwatch.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Build time against traversal speed of the BVH builders. The primitives are
+// count random spheres in a flat slab, like a particle or crowd scene; the
+// rays start outside it and aim at random points inside. Build times are the
+// fastest of runs builds on the pool; traversal runs on one thread, once for
+// the closest hit and once as an any-hit occlusion query.
+//
+// Each tree is then refitted to the spheres moved by up to kJitter, as an
+// animation step would, and compared with a tree built for the new positions:
+// refit time, SAH cost, and whether both find the same closest hits.
+
+struct BvhBuildTiming {
+    std::string name;
+    double build_ms = 0.0;
+    size_t nodes = 0;
+    double sah_cost = 0.0;
+    double mrays_per_second = 0.0;
+    double occluded_mrays_per_second = 0.0;
+    double refit_ms = 0.0;
+    double refit_sah_cost = 0.0;
+    double rebuilt_sah_cost = 0.0;
+    int refit_mismatches = 0;
+};
+
+void RunBvhBenchmark(std::ostream& out, ThreadPool& pool, int count = 1000000, int runs = 3, int rays = 200000) {
+    const double kJitter = 1.0;
+    SeedRandom(1);
+    std::vector<Point3> centers(count);
+    std::vector<Real> radii(count);
+    std::vector<Aabb> boxes(count);
+    auto hits_sphere = [&](const Ray& probe, const std::vector<Point3>& at, int i, Real t_min, Real t_max, Real& t) {
+        Vec3 oc = probe.Origin() - at[i];
+        Real a = probe.Direction().LengthSquared();
+        Real half_b = Dot(oc, probe.Direction());
+        Real disc = half_b * half_b - a * (oc.LengthSquared() - radii[i] * radii[i]);
+        if (disc < 0)
+            return false;
+        t = (-half_b - sqrt(disc)) / a;
+        return t >= t_min && t <= t_max;
+    };
+    for (int i = 0; i < count; i++) {
+        centers[i] = Point3(Real(RandomDouble(-100, 100)), Real(RandomDouble(-5, 5)), Real(RandomDouble(-100, 100)));
+        radii[i] = Real(RandomDouble(0.05, 0.5));
+        Vec3 r(radii[i], radii[i], radii[i]);
+        boxes[i] = Aabb(centers[i] - r, centers[i] + r);
+    }
+    std::vector<Ray> probes(rays);
+    for (auto& probe : probes) {
+        Point3 origin(Real(RandomDouble(-150, 150)), Real(RandomDouble(20, 60)), Real(RandomDouble(-150, 150)));
+        Point3 target(Real(RandomDouble(-100, 100)), 0, Real(RandomDouble(-100, 100)));
+        probe = Ray(origin, target - origin);
+    }
+
+    std::vector<Point3> moved_centers(count);
+    std::vector<Aabb> moved_boxes(count);
+    for (int i = 0; i < count; i++) {
+        moved_centers[i] = centers[i] + Vec3(Real(RandomDouble(-kJitter, kJitter)), Real(RandomDouble(-kJitter, kJitter)), Real(RandomDouble(-kJitter, kJitter)));
+        Vec3 r(radii[i], radii[i], radii[i]);
+        moved_boxes[i] = Aabb(moved_centers[i] - r, moved_centers[i] + r);
+    }
+    // Closest hit of every probe against the moved spheres through tree.
+    auto closest_hits = [&](const BvhTree& tree, const std::vector<int>& order) {
+        std::vector<Real> hits(probes.size(), infinity);
+        for (size_t k = 0; k < probes.size(); k++) {
+            tree.Intersect(probes[k], Real(0.001), infinity, [&](int position, Real t_min, Real& t_max) {
+                Real t;
+                if (!hits_sphere(probes[k], moved_centers, order[position], t_min, t_max, t))
+                    return false;
+                t_max = hits[k] = t;
+                return true;
+            });
+        }
+        return hits;
+    };
+
+    std::vector<std::pair<std::string, BvhBuildOptions>> configs;
+    for (int bins : { 4, 8, 16, 32 }) {
+        BvhBuildOptions options;
+        options.bins = bins;
+        configs.emplace_back("sah, " + std::to_string(bins) + " bins", options);
+    }
+    BvhBuildOptions lbvh;
+    lbvh.builder = BvhBuilder::LBVH;
+    configs.emplace_back("lbvh", lbvh);
+
+    std::vector<BvhBuildTiming> timings;
+    double checksum = 0.0;
+    for (auto& config : configs) {
+        BvhBuildTiming timing;
+        timing.name = config.first;
+        config.second.pool = &pool;
+        timing.build_ms = infinity;
+        BvhTree tree;
+        std::vector<int> order;
+        for (int run = 0; run < runs; run++) {
+            StopWatch stop_watch;
+            stop_watch.Begin();
+            order = tree.Build(boxes, config.second);
+            timing.build_ms = std::min(timing.build_ms, stop_watch.ElapsedNanoseconds() * 1e-6);
+        }
+        timing.nodes = tree.nodes.size();
+        timing.sah_cost = tree.SahCost();
+
+        StopWatch stop_watch;
+        stop_watch.Begin();
+        for (const Ray& probe : probes) {
+            Real closest = infinity;
+            tree.Intersect(probe, Real(0.001), infinity, [&](int position, Real t_min, Real& t_max) {
+                Real t;
+                if (!hits_sphere(probe, centers, order[position], t_min, t_max, t))
+                    return false;
+                t_max = closest = t;
+                return true;
+            });
+            checksum += closest < infinity ? double(closest) : 0.0;
+        }
+        timing.mrays_per_second = rays / (stop_watch.ElapsedNanoseconds() * 1e-3);
+
+        stop_watch.Begin();
+        for (const Ray& probe : probes) {
+            bool occluded = tree.Occluded(probe, Real(0.001), infinity, [&](int position, Real t_min, Real t_max) {
+                Real t;
+                return hits_sphere(probe, centers, order[position], t_min, t_max, t);
+            });
+            checksum += occluded ? 1.0 : 0.0;
+        }
+        timing.occluded_mrays_per_second = rays / (stop_watch.ElapsedNanoseconds() * 1e-3);
+
+        // Refit runs on one thread and includes gathering the boxes into leaf order.
+        std::vector<Aabb> leaf_boxes(count);
+        timing.refit_ms = infinity;
+        for (int run = 0; run < runs; run++) {
+            stop_watch.Begin();
+            for (int k = 0; k < count; k++)
+                leaf_boxes[k] = moved_boxes[order[k]];
+            tree.Refit(leaf_boxes);
+            timing.refit_ms = std::min(timing.refit_ms, stop_watch.ElapsedNanoseconds() * 1e-6);
+        }
+        timing.refit_sah_cost = tree.SahCost();
+
+        BvhTree rebuilt;
+        std::vector<int> rebuilt_order = rebuilt.Build(moved_boxes, config.second);
+        timing.rebuilt_sah_cost = rebuilt.SahCost();
+        std::vector<Real> refit_hits = closest_hits(tree, order);
+        std::vector<Real> rebuilt_hits = closest_hits(rebuilt, rebuilt_order);
+        for (int k = 0; k < rays; k++)
+            timing.refit_mismatches += refit_hits[k] != rebuilt_hits[k];
+        timings.push_back(timing);
+    }
+
+    out << "BVH builds over " << count << " spheres, best of " << runs << " runs on " << pool.NumThreads() << " threads; "
+        << rays << " rays on one thread:\n";
+    out << std::fixed;
+    for (const auto& timing : timings) {
+        out << "  " << std::left << std::setw(14) << timing.name << std::right << std::setprecision(1)
+            << std::setw(9) << timing.build_ms << " ms" << std::setw(8) << timing.build_ms * 1e6 / count << " ms/Mprim"
+            << std::setw(10) << timing.nodes << " nodes  SAH cost" << std::setw(7) << timing.sah_cost
+            << std::setprecision(2) << std::setw(8) << timing.mrays_per_second << " Mrays/s"
+            << std::setw(8) << timing.occluded_mrays_per_second << " occluded\n";
+    }
+    out << "Refit after moving every sphere by up to " << std::setprecision(1) << kJitter << " per axis, on one thread, against a rebuild:\n";
+    for (const auto& timing : timings) {
+        out << "  " << std::left << std::setw(14) << timing.name << std::right << std::setprecision(1)
+            << std::setw(9) << timing.refit_ms << " ms" << std::setw(8) << timing.refit_ms * 1e6 / count << " ms/Mprim"
+            << "  SAH cost" << std::setw(7) << timing.refit_sah_cost << " (rebuilt" << std::setw(7) << timing.rebuilt_sah_cost << ")"
+            << "  closest hits differ on " << timing.refit_mismatches << " of " << rays << " rays\n";
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6) << "  (checksum " << checksum << ")\n";
+}
+
+#endif // !BVH_BENCHMARK_H
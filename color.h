@@ -1,10 +1,12 @@
 #ifndef COLOR_H
 #define COLOR_H
 
-#include <iostream>
+#include <cstdint>
 #include "vec3.h"
 
-void WriteColor(std::ostream& out, Color pixel_color, int samples_per_pixel) {
+// Converts an accumulated pixel color to 8-bit sRGB-ish bytes: the color is
+// divided by the number of samples and gamma-corrected for gamma=2.0.
+void EncodeColor(Color pixel_color, int samples_per_pixel, uint8_t rgb[3]) {
     auto r = pixel_color.x();
     auto g = pixel_color.y();
     auto b = pixel_color.z();
@@ -15,11 +17,10 @@ void WriteColor(std::ostream& out, Color pixel_color, int samples_per_pixel) {
     g = sqrt(scale * g);
     b = sqrt(scale * b);
 
-    // Write the translated [0,255] value of each color component.
-    out << static_cast<int>(256 * Clamp(r, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * Clamp(g, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * Clamp(b, 0.0, 0.999)) << '\n';
+    // The translated [0,255] value of each color component.
+    rgb[0] = static_cast<uint8_t>(256 * Clamp(r, 0.0, 0.999));
+    rgb[1] = static_cast<uint8_t>(256 * Clamp(g, 0.0, 0.999));
+    rgb[2] = static_cast<uint8_t>(256 * Clamp(b, 0.0, 0.999));
 }
 
 #endif // !COLOR_HPP
-
@@ -0,0 +1,58 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "vec3.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Accumulated pixel colors of one image. Row 0 is the bottom scanline, matching
+// the (i, j) convention used by Render(). Tiles write disjoint pixels, so no
+// locking is needed while rendering.
+//
+// Pixels hold the sum of their samples. Uniform renders take the sample count
+// from the caller; adaptive renders call TrackSampleCounts() and record how
+// many samples each pixel received.
+class Framebuffer {
+public:
+    Framebuffer(int width, int height) : width_(width), height_(height), pixels_(static_cast<size_t>(width) * height) {}
+
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+
+    Color& At(int i, int j) { return pixels_[static_cast<size_t>(j) * width_ + i]; }
+    const Color& At(int i, int j) const { return pixels_[static_cast<size_t>(j) * width_ + i]; }
+
+    // Zeroes the pixels and sample counts for the next image, keeping the memory.
+    void Clear() {
+        std::fill(pixels_.begin(), pixels_.end(), Color());
+        std::fill(sample_counts_.begin(), sample_counts_.end(), 0);
+    }
+
+    void TrackSampleCounts() { sample_counts_.assign(pixels_.size(), 0); }
+    bool HasSampleCounts() const { return !sample_counts_.empty(); }
+    int& SampleCount(int i, int j) { return sample_counts_[static_cast<size_t>(j) * width_ + i]; }
+
+    // Samples summed into pixel (i, j); uniform_samples if counts are not tracked.
+    int SampleCount(int i, int j, int uniform_samples) const {
+        return sample_counts_.empty() ? uniform_samples : sample_counts_[static_cast<size_t>(j) * width_ + i];
+    }
+
+    uint64_t TotalSamples(int uniform_samples) const {
+        if (sample_counts_.empty())
+            return static_cast<uint64_t>(pixels_.size()) * uniform_samples;
+        uint64_t total = 0;
+        for (int count : sample_counts_)
+            total += count;
+        return total;
+    }
+
+private:
+    int width_;
+    int height_;
+    std::vector<Color> pixels_;
+    std::vector<int> sample_counts_;
+};
+
+#endif // !FRAMEBUFFER_H
@@ -2,21 +2,32 @@
 #define HITTABLE_H
 
 #include "utility.h"
+#include "aabb.h"
+#include "stats.h"
 //#include "material.h"
 
 class Material;
+class Hittable;
 
+// Concrete type of a Hittable. Sphere and Triangle are a closed set that
+// HitPrimitive (primitive.h) calls without virtual dispatch; every other
+// Hittable is OTHER, or MESH for stats, and goes through the vtable.
 enum class TYPE {
 	SPHERE,
-	TRIANGLE
+	TRIANGLE,
+	MESH,
+	OTHER
 };
 
 struct HitRecord {
 	Point3 p;
 	Vec3 normal;
-	shared_ptr<Material> mat_ptr;
-	double t;
-	bool front_face;
+	const Material* mat_ptr = nullptr; // owned by the Scene (or the primitive); copying a record costs no refcount
+	const Hittable* object = nullptr;  // the Sphere or Triangle hit, or the SpherePack, TriangleMesh or Instance around it
+	Real t = 0;
+	Real u = 0; // surface coordinates: barycentrics, or texture coordinates on meshes that have them
+	Real v = 0;
+	bool front_face = false;
 
 	inline void SetFaceNormal(const Ray& r, const Vec3& outward_normal) {
 		front_face = Dot(r.Direction(), outward_normal) < 0;
@@ -26,8 +37,32 @@ struct HitRecord {
 
 class Hittable {
 	public:
-		virtual bool Hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const = 0;
+		Hittable(TYPE type = TYPE::OTHER) : type_(type) {}
+
+		virtual bool Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const = 0;
+		// Traces count rays at once; hits[k] tells whether rays[k] hit and filled recs[k].
+		// Accelerators override it to share traversal between coherent rays.
+		virtual void HitPacket(const Ray* rays, int count, Real t_min, Real t_max, HitRecord* recs, bool* hits) const;
+		// Whether anything is hit in [t_min, t_max], for shadow and visibility
+		// rays. Stops at the first hit found and fills no record; the default
+		// falls back to Hit().
+		virtual bool Occluded(const Ray& r, Real t_min, Real t_max) const;
+		// Returns false for objects without finite bounds.
+		virtual bool BoundingBox(Aabb& output_box) const = 0;
+
+	public:
+		TYPE type_;
 };
 
+void Hittable::HitPacket(const Ray* rays, int count, Real t_min, Real t_max, HitRecord* recs, bool* hits) const {
+	for (int k = 0; k < count; k++)
+		hits[k] = Hit(rays[k], t_min, t_max, recs[k]);
+}
+
+bool Hittable::Occluded(const Ray& r, Real t_min, Real t_max) const {
+	HitRecord rec;
+	return Hit(r, t_min, t_max, rec);
+}
+
 #endif // !HITTABLE_H
 
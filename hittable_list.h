@@ -2,6 +2,7 @@
 #define Hittable_LIST_H
 
 #include "Hittable.h"
+#include "primitive.h"
 
 #include <memory>
 #include <vector>
@@ -17,26 +18,49 @@ public:
     void clear() { objects.clear(); }
     void add(shared_ptr<Hittable> object) { objects.push_back(object); }
 
-    virtual bool Hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override;
+    virtual bool Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override;
+    virtual bool Occluded(const Ray& r, Real t_min, Real t_max) const override;
+    virtual bool BoundingBox(Aabb& output_box) const override;
 
 public:
     std::vector<shared_ptr<Hittable>> objects;
 };
 
-bool HittableList::Hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const {
-    HitRecord temp_rec;
+bool HittableList::Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
+    // Hittables only touch rec on a hit closer than t_max, so it can be filled in place.
     for (const auto& object : objects) {
-        if (object->Hit(r, t_min, closest_so_far, temp_rec)) {
+        if (HitPrimitive(*object, r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
 
     return hit_anything;
 }
 
+bool HittableList::Occluded(const Ray& r, Real t_min, Real t_max) const {
+    for (const auto& object : objects) {
+        if (OccludedPrimitive(*object, r, t_min, t_max))
+            return true;
+    }
+    return false;
+}
+
+bool HittableList::BoundingBox(Aabb& output_box) const {
+    if (objects.empty()) return false;
+
+    Aabb temp_box;
+    output_box = Aabb();
+
+    for (const auto& object : objects) {
+        if (!object->BoundingBox(temp_box)) return false;
+        output_box.Expand(temp_box);
+    }
+
+    return true;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,274 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "color.h"
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Writers for a finished Framebuffer. Each one encodes the whole image into
+// memory first and then hands it to the stream in a single write.
+//
+//   .ppm  binary P6, 8 bits per channel, gamma 2
+//   .png  RGB8, gamma 2, stored (uncompressed) deflate blocks
+//   .pfm  linear 32-bit float RGB, for compositing
+//
+// Anything else falls back to the ASCII P3 output of WriteFramebuffer().
+
+// 8-bit RGB of the whole image, top scanline first. samples_per_pixel is used
+// unless the framebuffer tracks a sample count per pixel.
+std::vector<uint8_t> EncodeImage(const Framebuffer& framebuffer, int samples_per_pixel) {
+    int width = framebuffer.Width(), height = framebuffer.Height();
+    std::vector<uint8_t> bytes(static_cast<size_t>(width) * height * 3);
+    uint8_t* out = bytes.data();
+    for (int j = height - 1; j >= 0; --j) {
+        for (int i = 0; i < width; ++i, out += 3)
+            EncodeColor(framebuffer.At(i, j), std::max(1, framebuffer.SampleCount(i, j, samples_per_pixel)), out);
+    }
+    return bytes;
+}
+
+// ASCII P3, one "r g b" line per pixel.
+void WriteFramebuffer(std::ostream& out, const Framebuffer& framebuffer, int samples_per_pixel) {
+    auto bytes = EncodeImage(framebuffer, samples_per_pixel);
+
+    std::string text = "P3\n" + std::to_string(framebuffer.Width()) + ' ' + std::to_string(framebuffer.Height()) + "\n255\n";
+    text.reserve(text.size() + bytes.size() * 4);
+    for (size_t k = 0; k < bytes.size(); ++k) {
+        text += std::to_string(bytes[k]);
+        text += k % 3 == 2 ? '\n' : ' ';
+    }
+    out.write(text.data(), text.size());
+}
+
+void WritePpm(std::ostream& out, const Framebuffer& framebuffer, int samples_per_pixel) {
+    auto bytes = EncodeImage(framebuffer, samples_per_pixel);
+    std::string header = "P6\n" + std::to_string(framebuffer.Width()) + ' ' + std::to_string(framebuffer.Height()) + "\n255\n";
+    out.write(header.data(), header.size());
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+// Portable float map: little-endian (negative scale), rows bottom to top,
+// which is the framebuffer's own row order.
+void WritePfm(std::ostream& out, const Framebuffer& framebuffer, int samples_per_pixel) {
+    int width = framebuffer.Width(), height = framebuffer.Height();
+
+    std::vector<float> pixels(static_cast<size_t>(width) * height * 3);
+    float* p = pixels.data();
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            const Color& c = framebuffer.At(i, j);
+            float scale = 1.0f / std::max(1, framebuffer.SampleCount(i, j, samples_per_pixel));
+            *p++ = static_cast<float>(c.x()) * scale;
+            *p++ = static_cast<float>(c.y()) * scale;
+            *p++ = static_cast<float>(c.z()) * scale;
+        }
+    }
+
+    std::vector<char> bytes(pixels.size() * sizeof(float));
+    const uint32_t kOne = 1;
+    bool little_endian = *reinterpret_cast<const uint8_t*>(&kOne) == 1;
+    std::memcpy(bytes.data(), pixels.data(), bytes.size());
+    if (!little_endian) {
+        for (size_t k = 0; k < bytes.size(); k += 4) {
+            std::swap(bytes[k], bytes[k + 3]);
+            std::swap(bytes[k + 1], bytes[k + 2]);
+        }
+    }
+
+    std::string header = "PF\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n-1.0\n";
+    out.write(header.data(), header.size());
+    out.write(bytes.data(), bytes.size());
+}
+
+// PNG checksums.
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size) {
+    // 5552 bytes is the longest run before b can overflow 32 bits.
+    const uint32_t kMod = 65521;
+    const size_t kRun = 5552;
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t n = std::min(size, kRun);
+        for (size_t i = 0; i < n; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= kMod;
+        b %= kMod;
+        data += n;
+        size -= n;
+    }
+    return (b << 16) | a;
+}
+
+void AppendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void AppendPngChunk(std::vector<uint8_t>& out, const char type[4], const std::vector<uint8_t>& data) {
+    AppendBigEndian(out, static_cast<uint32_t>(data.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    AppendBigEndian(out, Crc32(out.data() + start, out.size() - start));
+}
+
+// Uncompressed PNG of 8-bit RGB bytes, top scanline first: no dependency on
+// zlib, and encoding costs one copy of the image. Files are about as large as a P6.
+void WritePngRgb(std::ostream& out, int width, int height, const std::vector<uint8_t>& bytes) {
+    // Scanlines, each preceded by filter type 0 (none).
+    size_t row_size = static_cast<size_t>(width) * 3;
+    std::vector<uint8_t> raw;
+    raw.reserve((row_size + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), bytes.begin() + y * row_size, bytes.begin() + (y + 1) * row_size);
+    }
+
+    // zlib stream of stored deflate blocks of at most 65535 bytes.
+    const size_t kMaxBlock = 65535;
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / kMaxBlock * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t size = std::min(kMaxBlock, raw.size() - offset);
+        bool last = offset + size == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(size));
+        zlib.push_back(static_cast<uint8_t>(size >> 8));
+        zlib.push_back(static_cast<uint8_t>(~size));
+        zlib.push_back(static_cast<uint8_t>(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+        offset += size;
+    } while (offset < raw.size());
+    AppendBigEndian(zlib, Adler32(raw.data(), raw.size()));
+
+    std::vector<uint8_t> header;
+    AppendBigEndian(header, static_cast<uint32_t>(width));
+    AppendBigEndian(header, static_cast<uint32_t>(height));
+    header.push_back(8);  // bit depth
+    header.push_back(2);  // color type: RGB
+    header.push_back(0);  // compression
+    header.push_back(0);  // filter
+    header.push_back(0);  // interlace
+
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    AppendPngChunk(png, "IHDR", header);
+    AppendPngChunk(png, "IDAT", zlib);
+    AppendPngChunk(png, "IEND", {});
+    out.write(reinterpret_cast<const char*>(png.data()), png.size());
+}
+
+void WritePng(std::ostream& out, const Framebuffer& framebuffer, int samples_per_pixel) {
+    WritePngRgb(out, framebuffer.Width(), framebuffer.Height(), EncodeImage(framebuffer, samples_per_pixel));
+}
+
+// Writes one value per pixel (row 0 at the bottom) as a false-color PNG,
+// black through blue, red and yellow to white at the 99th percentile, or as
+// a grey .pfm holding the raw values.
+bool WriteHeatmap(const std::string& path, int width, int height, const std::vector<float>& values) {
+    bool pfm = path.size() >= 4 && path.compare(path.size() - 4, 4, ".pfm") == 0;
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << path << ": cannot open for writing\n";
+        return false;
+    }
+
+    if (pfm) {
+        // PFM rows run bottom to top, like the values.
+        Framebuffer grey(width, height);
+        for (int j = 0; j < height; ++j)
+            for (int i = 0; i < width; ++i) {
+                Real v = Real(values[static_cast<size_t>(j) * width + i]);
+                grey.At(i, j) = Color(v, v, v);
+            }
+        WritePfm(out, grey, 1);
+        return bool(out);
+    }
+
+    std::vector<float> sorted(values);
+    float scale = 0.0f;
+    if (!sorted.empty()) {
+        auto p99 = sorted.begin() + (sorted.size() - 1) * 99 / 100;
+        std::nth_element(sorted.begin(), p99, sorted.end());
+        scale = *p99 > 0.0f ? 1.0f / *p99 : 0.0f;
+    }
+
+    const float kRamp[5][3] = { { 0, 0, 0 }, { 0, 0, 1 }, { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 1 } };
+    std::vector<uint8_t> bytes(static_cast<size_t>(width) * height * 3);
+    uint8_t* p = bytes.data();
+    for (int j = height - 1; j >= 0; --j) {
+        for (int i = 0; i < width; ++i, p += 3) {
+            float x = std::min(1.0f, values[static_cast<size_t>(j) * width + i] * scale) * 4.0f;
+            int k = std::min(3, static_cast<int>(x));
+            float f = x - k;
+            for (int c = 0; c < 3; ++c)
+                p[c] = static_cast<uint8_t>(255.0f * (kRamp[k][c] + f * (kRamp[k + 1][c] - kRamp[k][c])) + 0.5f);
+        }
+    }
+    WritePngRgb(out, width, height, bytes);
+    return bool(out);
+}
+
+// Writes the image to path in the format given by its extension.
+bool WriteImage(const std::string& path, const Framebuffer& framebuffer, int samples_per_pixel) {
+    auto dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    for (auto& c : extension)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << path << ": cannot open for writing\n";
+        return false;
+    }
+
+    if (extension == "png")
+        WritePng(out, framebuffer, samples_per_pixel);
+    else if (extension == "pfm")
+        WritePfm(out, framebuffer, samples_per_pixel);
+    else if (extension == "ppm")
+        WritePpm(out, framebuffer, samples_per_pixel);
+    else
+        WriteFramebuffer(out, framebuffer, samples_per_pixel);
+
+    if (!out) {
+        std::cerr << path << ": write failed\n";
+        return false;
+    }
+    return true;
+}
+
+#endif // !IMAGE_WRITER_H
@@ -0,0 +1,85 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "hittable.h"
+#include "primitive.h"
+
+// A Hittable placed in the scene through an affine transform. The geometry,
+// such as a TriangleMesh or a Bvh over a HittableList, is stored once and
+// shared by every instance of it, so a forest of one tree costs the tree plus
+// one Instance per copy. The scene's Bvh over the instances is the top level
+// of a two-level hierarchy; each geometry's own BVH is the bottom level.
+//
+// Rays are moved into object space and the hit is moved back. The direction
+// is not renormalized, so t is the same in both spaces. A singular transform,
+// or geometry without finite bounds, makes an empty instance.
+class Instance : public Hittable {
+public:
+    // material, if set, replaces the materials of the geometry.
+    Instance(shared_ptr<Hittable> object, const AffineTransform& object_to_world, const Material* material = nullptr);
+
+    virtual bool Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override;
+    virtual bool Occluded(const Ray& r, Real t_min, Real t_max) const override;
+    virtual bool BoundingBox(Aabb& output_box) const override;
+
+    const Hittable& Object() const { return *object_; }
+
+private:
+    shared_ptr<Hittable> object_;
+    AffineTransform world_to_object_;
+    const Material* material_;
+    Aabb box_;   // in world space
+    bool valid_ = false;
+};
+
+Instance::Instance(shared_ptr<Hittable> object, const AffineTransform& object_to_world, const Material* material)
+    : object_(object), material_(material) {
+    Aabb object_box;
+    if (!Inverse(object_to_world, world_to_object_) || !object_->BoundingBox(object_box))
+        return;
+
+    // The world box bounds the eight transformed corners of the object box.
+    for (int corner = 0; corner < 8; corner++) {
+        Point3 p((corner & 1 ? object_box.Max() : object_box.Min()).x(), (corner & 2 ? object_box.Max() : object_box.Min()).y(),
+            (corner & 4 ? object_box.Max() : object_box.Min()).z());
+        box_.Expand(object_to_world.Point(p));
+    }
+    box_.Pad();
+    valid_ = true;
+}
+
+bool Instance::Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
+    if (!valid_)
+        return false;
+
+    Ray local(world_to_object_.Point(r.Origin()), world_to_object_.Vector(r.Direction()));
+    if (!HitPrimitive(*object_, local, t_min, t_max, rec))
+        return false;
+
+    // Normals go back through the inverse transpose of object_to_world, which
+    // is the transpose of world_to_object. The transform keeps the sign of
+    // Dot(direction, normal), so front_face still holds.
+    rec.p = r.At(rec.t);
+    rec.normal = UnitVector(DotTransposed(world_to_object_.linear, rec.normal));
+    if (material_)
+        rec.mat_ptr = material_;
+    // The geometry is shared, so its primitives do not identify this copy.
+    rec.object = this;
+    return true;
+}
+
+bool Instance::Occluded(const Ray& r, Real t_min, Real t_max) const {
+    if (!valid_)
+        return false;
+    Ray local(world_to_object_.Point(r.Origin()), world_to_object_.Vector(r.Direction()));
+    return OccludedPrimitive(*object_, local, t_min, t_max);
+}
+
+bool Instance::BoundingBox(Aabb& output_box) const {
+    if (!valid_)
+        return false;
+    output_box = box_;
+    return true;
+}
+
+#endif // !INSTANCE_H
@@ -0,0 +1,239 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include "utility.h"
+#include "hittable.h"
+#include "material.h"
+#include "sampling.h"
+#include "sphere.h"
+#include "triangle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Picks index i with probability weights[i] / sum(weights) in constant time,
+// from one uniform number (Vose's alias method). Each of the n bins holds an
+// index and an alias; u selects a bin and then one of the two.
+class AliasTable {
+public:
+    // Returns false, leaving the table empty, if no weight is positive.
+    bool Build(const std::vector<double>& weights);
+
+    int Sample(double u) const;
+    double Pdf(int i) const { return pdf_[i]; }
+    size_t Size() const { return bins_.size(); }
+
+private:
+    struct Bin {
+        double threshold;   // keep the bin's own index below this fraction
+        int alias;
+    };
+
+    std::vector<Bin> bins_;
+    std::vector<double> pdf_;
+};
+
+bool AliasTable::Build(const std::vector<double>& weights) {
+    bins_.clear();
+    pdf_.clear();
+    double total = 0.0;
+    for (double w : weights)
+        total += std::max(w, 0.0);
+    if (!(total > 0.0))
+        return false;
+
+    size_t n = weights.size();
+    bins_.resize(n);
+    pdf_.resize(n);
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for (size_t i = 0; i < n; i++) {
+        pdf_[i] = std::max(weights[i], 0.0) / total;
+        scaled[i] = pdf_[i] * n;
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<int>(i));
+    }
+
+    // Fill each under-full bin from an over-full one.
+    while (!small.empty() && !large.empty()) {
+        int s = small.back(), l = large.back();
+        small.pop_back();
+        bins_[s] = Bin{ scaled[s], l };
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // What is left is full up to rounding.
+    for (int i : small)
+        bins_[i] = Bin{ 1.0, i };
+    for (int i : large)
+        bins_[i] = Bin{ 1.0, i };
+    return true;
+}
+
+int AliasTable::Sample(double u) const {
+    double scaled = u * bins_.size();
+    size_t bin = std::min(static_cast<size_t>(scaled), bins_.size() - 1);
+    return scaled - bin < bins_[bin].threshold ? static_cast<int>(bin) : bins_[bin].alias;
+}
+
+// A direction from a shading point to a light, as drawn by LightSampler.
+struct LightSample {
+    Vec3 wi;            // unit direction towards the light
+    Real distance;      // along wi to the point on the light
+    Color radiance;     // emitted towards the shading point
+    Real pdf;           // solid-angle density, light choice included
+};
+
+// The lights of a scene for next-event estimation: every Sphere and Triangle
+// whose material is a DiffuseLight. A light is picked with probability
+// proportional to its power through an alias table, so one sample costs the
+// same with ten lights or ten thousand. Triangles are then sampled uniformly
+// by area, spheres uniformly over the cone they subtend.
+//
+// Emitters inside meshes and instances are not listed. Paths still find them
+// by BSDF sampling alone, with full weight, because Pdf() is 0 for them.
+class LightSampler {
+public:
+    void Build(const std::vector<shared_ptr<Hittable>>& objects);
+
+    bool Empty() const { return lights_.empty(); }
+    size_t Size() const { return lights_.size(); }
+
+    // Picks a light with select and a point on it with u, as seen from p.
+    // Returns false if the sample carries no light: the point is behind the
+    // light's emitting face, or p is inside a spherical light.
+    bool Sample(const Point3& p, double select, Point2 u, LightSample& sample) const;
+
+    // Density with which Sample() from p draws the direction to the point rec
+    // on a light, or 0 if rec.object is not one of the lights.
+    Real Pdf(const Point3& p, const HitRecord& rec) const;
+
+private:
+    // 1 - cos(theta_max) of the cone a sphere subtends from p, or 0 from
+    // inside it; sampling is uniform over that cone.
+    static Real ConeSize(const Sphere& sphere, const Point3& p);
+
+private:
+    std::vector<const Hittable*> lights_;
+    std::unordered_map<const Hittable*, int> index_;
+    AliasTable table_;
+};
+
+inline Real Luminance(const Color& c) {
+    return Real(0.2126) * c.x() + Real(0.7152) * c.y() + Real(0.0722) * c.z();
+}
+
+// A DiffuseLight emits pi * L per unit area, so power is proportional to L times area.
+void LightSampler::Build(const std::vector<shared_ptr<Hittable>>& objects) {
+    lights_.clear();
+    index_.clear();
+    std::vector<double> power;
+    for (const auto& object : objects) {
+        const Material* material = nullptr;
+        double area = 0.0;
+        if (object->type_ == TYPE::SPHERE) {
+            auto& sphere = static_cast<const Sphere&>(*object);
+            material = sphere.mat_ptr_;
+            area = sphere.radius_ > 0 ? 4 * pi * sphere.radius_ * sphere.radius_ : 0.0;
+        } else if (object->type_ == TYPE::TRIANGLE) {
+            auto& triangle = static_cast<const Triangle&>(*object);
+            material = triangle.mat_ptr_;
+            area = 0.5 * Cross(triangle.edge1_, triangle.edge2_).Length();
+        }
+        if (!material || material->type_ != MaterialType::EMISSIVE)
+            continue;
+        double weight = Luminance(static_cast<const DiffuseLight*>(material)->emit) * area;
+        if (!(weight > 0.0))
+            continue;
+        index_[object.get()] = static_cast<int>(lights_.size());
+        lights_.push_back(object.get());
+        power.push_back(weight);
+    }
+    if (!table_.Build(power)) {
+        lights_.clear();
+        index_.clear();
+    }
+}
+
+bool LightSampler::Sample(const Point3& p, double select, Point2 u, LightSample& sample) const {
+    if (lights_.empty())
+        return false;
+    int index = table_.Sample(select);
+    const Hittable& light = *lights_[index];
+    Real choice_pdf = Real(table_.Pdf(index));
+
+    if (light.type_ == TYPE::TRIANGLE) {
+        auto& triangle = static_cast<const Triangle&>(light);
+        // Uniform on the triangle: fold the unit square onto it.
+        Real su = Real(std::sqrt(u.x));
+        Point3 x = triangle.a_ + su * (1 - Real(u.y)) * triangle.edge1_ + su * Real(u.y) * triangle.edge2_;
+        Vec3 d = x - p;
+        Real distance_squared = d.LengthSquared();
+        if (!(distance_squared > 0))
+            return false;
+        sample.distance = std::sqrt(distance_squared);
+        sample.wi = d / sample.distance;
+        Real cosine = -Dot(triangle.normal_, sample.wi);
+        if (cosine <= 0)
+            return false;
+        Real area = Real(0.5) * Cross(triangle.edge1_, triangle.edge2_).Length();
+        sample.pdf = choice_pdf * distance_squared / (cosine * area);
+        sample.radiance = static_cast<const DiffuseLight*>(triangle.mat_ptr_)->emit;
+        return true;
+    }
+
+    auto& sphere = static_cast<const Sphere&>(light);
+    Real cone_size = ConeSize(sphere, p);
+    if (cone_size <= 0)
+        return false;
+    Vec3 to_center = sphere.center_ - p;
+    Real center_distance = to_center.Length();
+
+    // 1 - cos(theta) is uniform in [0, cone_size]; sin^2 = (1 - cos)(1 + cos).
+    Real one_minus_cos = Real(u.x) * cone_size;
+    Real cos_theta = 1 - one_minus_cos;
+    Real sin_theta = std::sqrt(std::max(Real(0), one_minus_cos * (2 - one_minus_cos)));
+    Real phi = Real(2 * pi * u.y);
+    sample.wi = Onb(to_center / center_distance).Local(Vec3(std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, cos_theta));
+    // Near intersection of the ray with the sphere, from the triangle p, centre, hit point.
+    Real half_chord2 = sphere.radius_ * sphere.radius_ - center_distance * center_distance * sin_theta * sin_theta;
+    sample.distance = center_distance * cos_theta - std::sqrt(std::max(Real(0), half_chord2));
+    sample.pdf = choice_pdf / (2 * Real(pi) * cone_size);
+    sample.radiance = static_cast<const DiffuseLight*>(sphere.mat_ptr_)->emit;
+    return sample.distance > 0;
+}
+
+Real LightSampler::Pdf(const Point3& p, const HitRecord& rec) const {
+    auto it = index_.find(rec.object);
+    if (it == index_.end())
+        return 0;
+    Real choice_pdf = Real(table_.Pdf(it->second));
+
+    if (rec.object->type_ == TYPE::TRIANGLE) {
+        auto& triangle = static_cast<const Triangle&>(*rec.object);
+        Vec3 d = rec.p - p;
+        Real distance_squared = d.LengthSquared();
+        Real cosine = std::fabs(Dot(triangle.normal_, d)) / std::sqrt(distance_squared);
+        Real area = Real(0.5) * Cross(triangle.edge1_, triangle.edge2_).Length();
+        return cosine > 0 ? choice_pdf * distance_squared / (cosine * area) : 0;
+    }
+    Real cone_size = ConeSize(static_cast<const Sphere&>(*rec.object), p);
+    return cone_size > 0 ? choice_pdf / (2 * Real(pi) * cone_size) : 0;
+}
+
+Real LightSampler::ConeSize(const Sphere& sphere, const Point3& p) {
+    Real distance_squared = (sphere.center_ - p).LengthSquared();
+    Real radius_squared = sphere.radius_ * sphere.radius_;
+    if (distance_squared <= radius_squared)
+        return 0;
+    // Series for small, distant spheres, where 1 - sqrt(1 - x) cancels.
+    Real sin2_max = radius_squared / distance_squared;
+    return sin2_max < Real(1e-4) ? sin2_max * (Real(0.5) + sin2_max / 8) : 1 - std::sqrt(1 - sin2_max);
+}
+
+#endif // !LIGHTS_H
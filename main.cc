@@ -7,156 +7,326 @@
 #include "camera.h"
 #include "material.h"
 #include "stopwatch.h"
-
+#include "renderer.h"
+#include "wavefront.h"
+#include "image_writer.h"
+#include "progressive.h"
+#include "benchmark.h"
+#include "sampling_benchmark.h"
+#include "arena_benchmark.h"
+#include "bvh_benchmark.h"
+#include "bvh.h"
+#include "mesh_loader.h"
+#include "scene.h"
+#include "scenes.h"
+#include "scene_file.h"
+#include "batch.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
-
-Color RayColor(const Ray& r, const Hittable& world, int depth) {
-    HitRecord rec;
-    
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return Color(0, 0, 0);
-
-    if (world.Hit(r, 0.001, infinity, rec)) {
-        Ray scattered;
-        Color attenuation;
-        if (rec.mat_ptr->Scatter(r, rec, attenuation, scattered))
-            return attenuation * RayColor(scattered, world, depth - 1);
-        return Color(0, 0, 0);
-    }
-
-    Vec3 unit_direction = UnitVector(r.Direction());
-    auto t = 0.5 * (unit_direction.y() + 1.0);
-    return (1.0 - t) * Color(1.0, 1.0, 1.0) + t * Color(0.5, 0.7, 1.0);
-}
-
-void GenerateWorldWithTriangles(HittableList& world) {
-    auto material_ground = make_shared<Lambertian>(Color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<Lambertian>(Color(0.7, 0.3, 0.3));
-    shared_ptr<Metal> material_left = make_shared<Metal>(Color(0.8,0.8,0.8), 0.3);
-    shared_ptr<Metal> material_right = make_shared<Metal>(Color(0.8,0.6,0.2), 1.0);
-
-    world.add(make_shared<Sphere>(Point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<Sphere>(Point3(0.0, 0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<Triangle>(Point3(-1.0, 0.4, -1), Point3(-1.8, -0.3, -1), Point3(-0.8, -0.3, -1), material_left));
-    world.add(make_shared<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, material_right));
-
-}
-
-HittableList RandomScene() {
-    HittableList world;
-
-    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
-    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
-
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            auto choose_mat = RandomDouble();
-            Point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
-
-            if ((center - Point3(4, 0.2, 0)).Length() > 0.9) {
-                shared_ptr<Material> sphere_material;
-
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = Color::Random() * Color::Random();
-                    sphere_material = make_shared<Lambertian>(albedo);
-                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
-                }
-                else if (choose_mat < 0.95) {
-                    // metal
-                    auto albedo = Color::Random(0.5, 1);
-                    auto fuzz = RandomDouble(0, 0.5);
-                    sphere_material = make_shared<Metal>(albedo, fuzz);
-                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
-                }
-                else {
-                    // glass
-                    sphere_material = make_shared<Dielectric>(1.5);
-                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
-                }
+#include <string>
+#include <thread>
+
+int main(int argc, char* argv[]) {
+
+    // Options
+
+    int num_threads = static_cast<int>(std::thread::hardware_concurrency());
+    int tile_size = 32;
+    uint64_t seed = 1;
+    int max_depth = 10;
+    int roulette_depth = 3;
+    int samples_per_pixel = 10;
+    bool adaptive = false;
+    double noise_threshold = 0.01;
+    int min_samples = 8;
+    double time_budget = 0.0;
+    std::string sample_map_path;
+    SamplerType sampler = SamplerType::INDEPENDENT;
+    bool progressive = false;
+    ProgressiveOptions progressive_options;
+    std::string tile_stats_path;
+    std::string stats_heatmap_path;
+    std::string output_path;
+    bool use_bvh = true;
+    bool use_sphere_packs = true;
+    BvhBuildOptions bvh_options;
+    bool wavefront = false;
+    bool next_event = true;
+    std::string scene_name;
+    std::string save_scene_path;
+    bool use_mapping = true;
+    std::string batch_path;
+    int orbit_frames = 0;
+    std::vector<std::string> mesh_paths;
+    std::string benchmark_path;
+    int benchmark_runs = 5;
+    int bvh_benchmark_count = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--tile") && i + 1 < argc)
+            tile_size = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--max-depth") && i + 1 < argc)
+            max_depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--roulette-depth") && i + 1 < argc)
+            roulette_depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--samples") && i + 1 < argc)
+            samples_per_pixel = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--adaptive") && i + 1 < argc) {
+            adaptive = true;
+            noise_threshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--min-samples") && i + 1 < argc)
+            min_samples = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--time-budget") && i + 1 < argc) {
+            adaptive = true;
+            time_budget = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sample-map") && i + 1 < argc)
+            sample_map_path = argv[++i];
+        else if (!strcmp(argv[i], "--sampler") && i + 1 < argc) {
+            if (!ParseSamplerType(argv[++i], sampler)) {
+                std::cerr << "Unknown sampler " << argv[i] << "; use independent, stratified, sobol or bluenoise\n";
+                return 1;
             }
-        }
-    }
-
-    auto material1 = make_shared<Dielectric>(1.5);
-    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
-
-    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
-
-    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
-
-    return world;
-}
-
-void Render(int image_width, int image_height, int samples_per_pixel, int max_depth, const HittableList& world, const Camera& cam) {
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-    for (int j = image_height - 1; j >= 0; --j) {
-        std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
-        for (int i = 0; i < image_width; ++i) {
-            Color pixel_Color(0, 0, 0);
-            for (int s = 0; s < samples_per_pixel; ++s) {
-                auto u = (i + RandomDouble()) / (image_width - 1);
-                auto v = (j + RandomDouble()) / (image_height - 1);
-                Ray r = cam.GetRay(u, v);
-                pixel_Color += RayColor(r, world, max_depth);
+        } else if (!strcmp(argv[i], "--progressive"))
+            progressive = true;
+        else if (!strcmp(argv[i], "--pass-samples") && i + 1 < argc)
+            progressive_options.pass_samples = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc) {
+            progressive = true;
+            progressive_options.checkpoint_path = argv[++i];
+        } else if (!strcmp(argv[i], "--checkpoint-interval") && i + 1 < argc)
+            progressive_options.checkpoint_interval = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--resume"))
+            progressive_options.resume = true;
+        else if (!strcmp(argv[i], "--preview") && i + 1 < argc) {
+            progressive = true;
+            progressive_options.preview_path = argv[++i];
+        } else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+            output_path = argv[++i];
+        else if (!strcmp(argv[i], "--tile-stats") && i + 1 < argc)
+            tile_stats_path = argv[++i];
+        else if (!strcmp(argv[i], "--stats-heatmap") && i + 1 < argc)
+            stats_heatmap_path = argv[++i];
+        else if (!strcmp(argv[i], "--scene") && i + 1 < argc)
+            scene_name = argv[++i];
+        else if (!strcmp(argv[i], "--save-scene") && i + 1 < argc)
+            save_scene_path = argv[++i];
+        else if (!strcmp(argv[i], "--batch") && i + 1 < argc)
+            batch_path = argv[++i];
+        else if (!strcmp(argv[i], "--orbit") && i + 1 < argc)
+            orbit_frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--no-mmap"))
+            use_mapping = false;
+        else if (!strcmp(argv[i], "--benchmark") && i + 1 < argc)
+            benchmark_path = argv[++i];
+        else if (!strcmp(argv[i], "--benchmark-runs") && i + 1 < argc)
+            benchmark_runs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--benchmark-sampling")) {
+            RunSamplingBenchmark(std::cout);
+            return 0;
+        } else if (!strcmp(argv[i], "--benchmark-bvh") && i + 1 < argc)
+            bvh_benchmark_count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--benchmark-arena") && i + 1 < argc) {
+            RunArenaBenchmark(std::cout, strtoull(argv[++i], nullptr, 10));
+            return 0;
+        } else if (!strcmp(argv[i], "--mesh") && i + 1 < argc)
+            mesh_paths.push_back(argv[++i]);
+        else if (!strcmp(argv[i], "--no-bvh"))
+            use_bvh = false;
+        else if (!strcmp(argv[i], "--no-sphere-packs"))
+            use_sphere_packs = false;
+        else if (!strcmp(argv[i], "--bvh-builder") && i + 1 < argc) {
+            if (!ParseBvhBuilder(argv[++i], bvh_options.builder)) {
+                std::cerr << "Unknown BVH builder " << argv[i] << "; use sah or lbvh\n";
+                return 1;
             }
-            WriteColor(std::cout, pixel_Color, samples_per_pixel);
+        } else if (!strcmp(argv[i], "--bvh-bins") && i + 1 < argc)
+            bvh_options.bins = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--wavefront"))
+            wavefront = true;
+        else if (!strcmp(argv[i], "--no-nee"))
+            next_event = false;
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--threads N] [--tile PX] [--seed N] [--max-depth N] [--roulette-depth N] [--samples N] [--sampler independent|stratified|sobol|bluenoise] [--adaptive THRESHOLD] [--min-samples N] [--time-budget SECONDS] [--sample-map FILE.png|pfm] [--progressive] [--pass-samples N] [--checkpoint FILE] [--checkpoint-interval SECONDS] [--resume] [--preview FILE] [--output FILE.ppm|png|pfm] [--batch FILE] [--orbit FRAMES] [--tile-stats FILE.csv] [--stats-heatmap FILE.png|pfm] [--no-bvh] [--no-sphere-packs] [--bvh-builder sah|lbvh] [--bvh-bins N] [--wavefront] [--no-nee] [--scene default|random|triangles|mesh|instances|cornell|lights|FILE.scene|FILE.rtscene] [--save-scene FILE.scene|rtscene] [--mesh FILE.obj|ply]... [--no-mmap] [--benchmark FILE.json|-] [--benchmark-runs N] [--benchmark-sampling] [--benchmark-arena PRIMITIVES] [--benchmark-bvh PRIMITIVES]\n";
+            return 1;
         }
     }
+    if (num_threads < 1)
+        num_threads = 1;
+    if (tile_size < 1)
+        tile_size = 32;
+    if (max_depth < 1)
+        max_depth = 1;
+    if (benchmark_runs < 1)
+        benchmark_runs = 1;
+    if (samples_per_pixel < 1)
+        samples_per_pixel = 1;
+    if (adaptive && wavefront)
+        std::cerr << "--adaptive renders pixel by pixel; --wavefront ignored\n";
+    if (progressive && (adaptive || wavefront)) {
+        std::cerr << "--progressive renders uniform passes; --adaptive and --wavefront ignored\n";
+        adaptive = wavefront = false;
+    }
+    bool batch = !batch_path.empty() || orbit_frames > 0;
+    if (batch && progressive) {
+        std::cerr << "--batch and --orbit render whole frames; --progressive ignored\n";
+        progressive = false;
+    }
+    if (progressive_options.resume && progressive_options.checkpoint_path.empty())
+        std::cerr << "--resume needs --checkpoint FILE; ignored\n";
+    if (IsSceneFile(scene_name) && !mesh_paths.empty())
+        std::cerr << "--mesh adds to the built-in scenes; use mesh statements in " << scene_name << "\n";
+#ifndef RAYTRACER_STATS
+    if (!stats_heatmap_path.empty())
+        std::cerr << "--stats-heatmap needs a build with RAYTRACER_STATS; ignored\n";
+#endif
 
-    std::cerr << "\nDone.\n";
-}
-
-int main() {
+    SeedRandom(seed);
 
     // Image
 
     const auto kAspectRatio = 3.0 / 2.0;
     const int kImgWidth = 400;
     const int kImgHeight = static_cast<int>(kImgWidth / kAspectRatio);
-    const int kSamplesPerPixel = 10;
-    const int kMaxDepth = 10;
+
+    RenderSettings settings;
+    settings.image_width = kImgWidth;
+    settings.image_height = kImgHeight;
+    settings.samples_per_pixel = samples_per_pixel;
+    settings.max_depth = max_depth;
+    settings.roulette_depth = roulette_depth;
+    settings.tile_size = tile_size;
+    settings.seed = seed;
+    settings.sampler = sampler;
+    settings.wavefront = wavefront;
+    settings.adaptive = adaptive;
+    settings.noise_threshold = static_cast<Real>(noise_threshold);
+    settings.min_samples = min_samples;
+    settings.time_budget = time_budget;
+    settings.next_event = next_event;
+
+    ThreadPool pool(num_threads);
+    bvh_options.pool = &pool;
+
+    if (bvh_benchmark_count > 0) {
+        RunBvhBenchmark(std::cout, pool, bvh_benchmark_count);
+        return 0;
+    }
+
+    // Benchmark: every canonical scene, or only --scene, several times.
+
+    if (!benchmark_path.empty()) {
+        BenchmarkOptions options;
+        options.runs = benchmark_runs;
+        if (!scene_name.empty())
+            options.scenes = { scene_name };
+        options.mesh_paths = mesh_paths;
+        options.use_mapping = use_mapping;
+        options.use_bvh = use_bvh;
+        options.use_sphere_packs = use_sphere_packs;
+        options.bvh = bvh_options;
+        options.json_path = benchmark_path;
+        return RunBenchmark(settings, kAspectRatio, pool, options) ? 0 : 1;
+    }
 
     // World
 
-    //HittableList world = RandomScene();
-    HittableList world;
-
-    auto material_ground = make_shared<Lambertian>(Color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<Dielectric>(1.5);
-    auto material_left = make_shared<Dielectric>(1.5);
-    auto material_right = make_shared<Metal>(Color(0.8, 0.6, 0.2), 1.0);
-
-    world.add(make_shared<Sphere>(Point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<Sphere>(Point3(0.0, 0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    world.add(make_shared<Triangle>(Point3(-3.0, 0.5, -1.0), Point3(-4.0, -0.3, -1.0), Point3(-2.0, -0.3, -1.0), material_left));
-    world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), -0.4, material_left));
-    world.add(make_shared<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, material_right));
-    
-    // Camera
-
-    //Point3 lookfrom(6, 1, 2);
-    Point3 lookfrom(4, 1, 10);
-    Point3 lookat(0, 0, 0);
-    Vec3 vup(0, 1, 0);
-    auto dist_to_focus = 10.0;
-    auto aperture = 0.1;
-
-    Camera cam(lookfrom, lookat, vup, 20, kAspectRatio, aperture, dist_to_focus);
-
-    // Benchmark
-    StopWatch stop_watch;
-    stop_watch.Begin();
+    StopWatch setup_watch;
+    setup_watch.Begin();
+    Scene world;
+    View view;
+    SceneLoadStats load_stats;
+    if (!BuildScene(scene_name.empty() ? "default" : scene_name, world, view, mesh_paths, &load_stats, use_mapping))
+        return 1;
+    if (IsSceneFile(scene_name))
+        ReportSceneLoad(std::cerr, scene_name, load_stats);
+    if (!save_scene_path.empty())
+        return SaveSceneFile(save_scene_path, world, view) ? 0 : 1;
+    Camera cam = MakeCamera(view, kAspectRatio);
+
+    // Acceleration structure
+
+    auto build_start = std::chrono::steady_clock::now();
+    world.Build(use_bvh, use_sphere_packs, bvh_options);
+    auto build_end = std::chrono::steady_clock::now();
+    if (use_bvh)
+        std::cerr << "BVH: " << world.Accelerator().PrimitiveCount() << " primitives, " << world.Accelerator().NodeCount() << " nodes, built in "
+                  << std::chrono::duration<double, std::milli>(build_end - build_start).count() << " ms\n";
+    settings.lights = &world.Lights();
+    settings.sky = world.sky;
+    if (!world.Lights().Empty())
+        std::cerr << "Lights: " << world.Lights().Size() << (next_event ? ", sampled at diffuse hits" : ", found by BSDF sampling only") << "\n";
+
+    // Batch: many frames over the scene built above.
+
+    if (batch) {
+        std::vector<View> frames;
+        if (!batch_path.empty() && !LoadBatchFile(batch_path, view, frames))
+            return 1;
+        if (orbit_frames > 0) {
+            auto orbit = OrbitFrames(frames.empty() ? view : frames.back(), orbit_frames, 360.0);
+            frames.insert(frames.end(), orbit.begin(), orbit.end());
+        }
+        double setup_ms = setup_watch.ElapsedNanoseconds() * 1e-6;
+        return RenderBatch(settings, kAspectRatio, world.Root(), frames, output_path.empty() ? "frame_%04d.png" : output_path, pool, setup_ms) ? 0 : 1;
+    }
 
     // Render
 
-    Render(kImgWidth, kImgHeight, kSamplesPerPixel, kMaxDepth, world, cam);
+    StopWatch stop_watch;
+    stop_watch.Begin();
+
+    Framebuffer framebuffer(kImgWidth, kImgHeight);
+    std::vector<TileStats> tile_stats;
+
+    if (progressive) {
+        // The contents of every file the scene came from, so that editing a
+        // scene or mesh file invalidates its checkpoints. A --mesh path the
+        // scene did not load may not exist; it counts by name only.
+        progressive_options.scene_id = HashString(scene_name.empty() ? "default" : scene_name);
+        for (const auto& path : IsSceneFile(scene_name) ? load_stats.files : mesh_paths) {
+            progressive_options.scene_id = HashString(path, progressive_options.scene_id);
+            HashFile(path, progressive_options.scene_id);
+        }
+        // A resumed render matches an uninterrupted one bit for bit, and
+        // light sampling changes every sample.
+        if (!next_event && !world.Lights().Empty())
+            progressive_options.scene_id = HashString("--no-nee", progressive_options.scene_id);
+        if (!RenderProgressive(settings, progressive_options, world.Root(), cam, pool, framebuffer, tile_stats))
+            return 1;
+    } else {
+        Render(settings, world.Root(), cam, pool, framebuffer, tile_stats);
+    }
+    if (output_path.empty())
+        WriteFramebuffer(std::cout, framebuffer, samples_per_pixel);
+    else if (!WriteImage(output_path, framebuffer, samples_per_pixel))
+        return 1;
+    ReportTileStats(settings, tile_stats, pool.NumThreads(), tile_stats_path);
+    if (adaptive) {
+        std::vector<float> sample_map(static_cast<size_t>(kImgWidth) * kImgHeight);
+        for (int j = 0; j < kImgHeight; ++j)
+            for (int i = 0; i < kImgWidth; ++i)
+                sample_map[static_cast<size_t>(j) * kImgWidth + i] = static_cast<float>(framebuffer.SampleCount(i, j));
+        auto range = std::minmax_element(sample_map.begin(), sample_map.end());
+        std::cerr << "Adaptive: " << double(framebuffer.TotalSamples(samples_per_pixel)) / sample_map.size() << " samples per pixel on average, "
+                  << *range.first << " to " << *range.second << "\n";
+        if (!sample_map_path.empty() && !WriteHeatmap(sample_map_path, kImgWidth, kImgHeight, sample_map))
+            return 1;
+    }
+#ifdef RAYTRACER_STATS
+    ReportStats(std::cerr);
+    if (!stats_heatmap_path.empty() && !WriteHeatmap(stats_heatmap_path, Stats().width, Stats().height, Stats().pixel_ns))
+        return 1;
+#endif
 
+    // Status goes to std::cerr so it never ends up in the image on std::cout.
     double dur = stop_watch.Stop();
-    std::cout << "Render duration: " << dur << "s" << std::endl;
+    std::cerr << "Render duration: " << dur << "s" << std::endl;
 }
\ No newline at end of file
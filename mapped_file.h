@@ -0,0 +1,146 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. Files are memory-mapped when the platform
+// allows it; otherwise, or when use_mapping is false, they are read into memory.
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path, bool use_mapping = true);
+    void Close();
+
+    const char* Data() const { return data_; }
+    size_t Size() const { return size_; }
+    bool IsMapped() const { return mapped_; }
+
+private:
+    bool Map(const std::string& path);
+    bool Read(const std::string& path);
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<char> buffer_;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+bool MappedFile::Open(const std::string& path, bool use_mapping) {
+    Close();
+    if (use_mapping && Map(path))
+        return true;
+    return Read(path);
+}
+
+void MappedFile::Close() {
+    if (mapped_) {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle(mapping_);
+        CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+}
+
+bool MappedFile::Map(const std::string& path) {
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping_) CloseHandle(mapping_);
+        CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+    mapped_ = true;
+    return true;
+}
+
+bool MappedFile::Read(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    buffer_.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(buffer_.data(), static_cast<std::streamsize>(buffer_.size())))
+        return false;
+
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    return true;
+}
+
+#endif // !MAPPED_FILE_H
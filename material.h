@@ -2,25 +2,40 @@
 #define MATERIAL_H
 
 #include "utility.h"
+#include "sampler.h"
 //#include "hittable.h"
 
 struct HitRecord;
 
+// Concrete material of a Material, so batched shading can sort hits by it and
+// call each Scatter without virtual dispatch.
+enum class MaterialType {
+    LAMBERTIAN,
+    METAL,
+    DIELECTRIC,
+    EMISSIVE,
+    OTHER
+};
+
 class Material {
 public:
+    Material(MaterialType type = MaterialType::OTHER) : type_(type) {}
+
     virtual bool Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered) const = 0;
+    // Radiance the surface gives off at rec, towards the ray that hit it.
+    virtual Color Emitted(const HitRecord&) const { return Color(0, 0, 0); }
+
+public:
+    MaterialType type_;
 };
 
-class Lambertian : public Material {
+class Lambertian final : public Material {
 public:
-    Lambertian(const Color& a) : albedo(a) {}
+    Lambertian(const Color& a) : Material(MaterialType::LAMBERTIAN), albedo(a) {}
 
-    virtual bool Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered) const override {
-        auto scatter_direction = rec.normal + RandomUnitVectorInSphere();
-        // Catch degenerate scatter direction
-        if (scatter_direction.NearZero())
-            scatter_direction = rec.normal;
-        scattered = Ray(rec.p, scatter_direction);
+    virtual bool Scatter(const Ray&, const HitRecord& rec, Color& attenuation, Ray& scattered) const override {
+        // Cosine-weighted about the normal, which is the Lambertian density.
+        scattered = Ray(rec.p, Onb(rec.normal).Local(SampleCosineHemisphere(Sample2D())));
         attenuation = albedo;
         return true;
     }
@@ -29,39 +44,41 @@ public:
     Color albedo;
 };
 
-class Metal : public Material {
+class Metal final : public Material {
 public:
-    Metal(const Color& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+    Metal(const Color& a, Real f) : Material(MaterialType::METAL), albedo(a), fuzz(f < 1 ? f : 1) {}
 
     virtual bool Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered) const override {
         Vec3 reflected = Reflect(UnitVector(r_in.Direction()), rec.normal);
-        scattered = Ray(rec.p, reflected + fuzz * RandomInUnitSphere());
+        Point2 u = Sample2D();
+        Real w = Real(Sample1D());
+        scattered = Ray(rec.p, reflected + fuzz * SampleUnitBall(u, w));
         attenuation = albedo;
         return (Dot(scattered.Direction(), rec.normal) > 0);
     }
 
 public:
     Color albedo;
-    double fuzz;
+    Real fuzz;
 };
 
-class Dielectric : public Material {
+class Dielectric final : public Material {
 public:
-    Dielectric(double index_of_refraction) : ir(index_of_refraction) {}
+    Dielectric(Real index_of_refraction) : Material(MaterialType::DIELECTRIC), ir(index_of_refraction) {}
 
     virtual bool Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered
     ) const override {
-        attenuation = Color(1.0, 1.0, 1.0);
-        double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
+        attenuation = Color(1, 1, 1);
+        Real refraction_ratio = rec.front_face ? (1 / ir) : ir;
 
         Vec3 unit_direction = UnitVector(r_in.Direction());
-        double cos_theta = fmin(Dot(-unit_direction, rec.normal), 1.0);
-        double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+        Real cos_theta = fmin(Dot(-unit_direction, rec.normal), Real(1));
+        Real sin_theta = sqrt(1 - cos_theta * cos_theta);
 
-        bool cannot_refract = refraction_ratio * sin_theta > 1.0;
+        bool cannot_refract = refraction_ratio * sin_theta > 1;
         Vec3 direction;
 
-        if (cannot_refract || Reflectance(cos_theta, refraction_ratio) > RandomDouble())
+        if (cannot_refract || Reflectance(cos_theta, refraction_ratio) > Sample1D())
             direction = Reflect(unit_direction, rec.normal);
         else
             direction = Refract(unit_direction, rec.normal, refraction_ratio);
@@ -71,9 +88,9 @@ public:
     }
 
 public:
-    double ir; // Index of Refraction
+    Real ir; // Index of Refraction
 private:
-    static double Reflectance(double cosine, double ref_idx) {
+    static Real Reflectance(Real cosine, Real ref_idx) {
         // Use Schlick's approximation for reflectance.
         auto r0 = (1 - ref_idx) / (1 + ref_idx);
         r0 = r0 * r0;
@@ -81,4 +98,56 @@ private:
     }
 };
 
+// Area light: emits radiance from its front face and absorbs everything that
+// hits it. Spheres and triangles made of it are the scene's lights
+// (lights.h).
+class DiffuseLight final : public Material {
+public:
+    DiffuseLight(const Color& e) : Material(MaterialType::EMISSIVE), emit(e) {}
+
+    virtual bool Scatter(const Ray&, const HitRecord&, Color&, Ray&) const override {
+        return false;
+    }
+
+    virtual Color Emitted(const HitRecord& rec) const override {
+        return rec.front_face ? emit : Color(0, 0, 0);
+    }
+
+public:
+    Color emit;
+};
+
+// Scatters off m, calling the built-in materials directly when type_ names
+// them, so their Scatter can be inlined into the path loop. Materials of type
+// OTHER go through the virtual call.
+inline bool ScatterMaterial(const Material& m, const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered) {
+    switch (m.type_) {
+    case MaterialType::LAMBERTIAN:
+        return static_cast<const Lambertian&>(m).Lambertian::Scatter(r_in, rec, attenuation, scattered);
+    case MaterialType::METAL:
+        return static_cast<const Metal&>(m).Metal::Scatter(r_in, rec, attenuation, scattered);
+    case MaterialType::DIELECTRIC:
+        return static_cast<const Dielectric&>(m).Dielectric::Scatter(r_in, rec, attenuation, scattered);
+    case MaterialType::EMISSIVE:
+        return false;
+    default:
+        return m.Scatter(r_in, rec, attenuation, scattered);
+    }
+}
+
+// Sets emitted to the radiance m gives off at rec and returns true, or
+// returns false at once for the built-in materials that emit nothing.
+inline bool EmittedMaterial(const Material& m, const HitRecord& rec, Color& emitted) {
+    switch (m.type_) {
+    case MaterialType::EMISSIVE:
+        emitted = static_cast<const DiffuseLight&>(m).DiffuseLight::Emitted(rec);
+        return true;
+    case MaterialType::OTHER:
+        emitted = m.Emitted(rec);
+        return true;
+    default:
+        return false;
+    }
+}
+
 #endif
\ No newline at end of file
@@ -3,24 +3,26 @@
 
 #include "vec3.h"
 
+#include <cmath>
 #include <ostream>
 
-class Matrix3 {
+template <typename T>
+class Matrix3T {
 public:
-	Matrix3() : e{ 0,0,0,0,0,0,0,0,0 } {};
-	Matrix3(double e1, double e2, double e3, double e4, double e5, double e6, double e7, double e8, double e9) {
+	Matrix3T() : e{ 0,0,0,0,0,0,0,0,0 } {};
+	Matrix3T(T e1, T e2, T e3, T e4, T e5, T e6, T e7, T e8, T e9) {
 		e[0] = e1, e[1] = e2, e[2] = e3, e[3] = e4, e[4] = e5, e[5] = e6, e[6] = e7, e[7] = e8, e[8] = e9;
 	}
-	Matrix3(const Vec3& v1, const Vec3& v2, const Vec3& v3) {
+	Matrix3T(const Vec3T<T>& v1, const Vec3T<T>& v2, const Vec3T<T>& v3) {
 		e[0] = v1.e[0], e[1] = v1.e[1], e[2] = v1.e[2];
 		e[3] = v2.e[0], e[4] = v2.e[1], e[5] = v2.e[2];
 		e[6] = v3.e[0], e[7] = v3.e[1], e[8] = v3.e[2];
 	}
 
-	double operator[](int i) const { return e[i]; }
-	double& operator[](int i) { return e[i]; }
+	T operator[](int i) const { return e[i]; }
+	T& operator[](int i) { return e[i]; }
 
-	Matrix3& operator+=(const Matrix3& o) {
+	Matrix3T& operator+=(const Matrix3T& o) {
 		e[0] += o.e[0];
 		e[1] += o.e[1];
 		e[2] += o.e[2];
@@ -33,90 +35,119 @@ public:
 		return *this;
 	}
 
-	Matrix3 operator-() const {
-		return Matrix3(-e[0], -e[1], -e[2],
+	Matrix3T operator-() const {
+		return Matrix3T(-e[0], -e[1], -e[2],
 			-e[3], -e[4], -e[5],
 			-e[6], -e[7], -e[8]);
 	}
 
-	Matrix3& operator*=(const double t) {
+	Matrix3T& operator*=(const T t) {
 		e[0] *= t, e[1] *= t, e[2] *= t;
 		e[3] *= t, e[4] *= t, e[5] *= t;
 		e[6] *= t, e[7] *= t, e[8] *= t;
 		return *this;
 	}
 
-	Matrix3& operator/=(const double t) {
+	Matrix3T& operator/=(const T t) {
 		return *this *= 1 / t;
 	}
 
+	static Matrix3T Identity() {
+		return Matrix3T(1, 0, 0, 0, 1, 0, 0, 0, 1);
+	}
+
+	// Rotation by radians about axis, counterclockwise looking down the axis.
+	static Matrix3T Rotation(const Vec3T<T>& axis, T radians) {
+		Vec3T<T> a = UnitVector(axis);
+		T c = cos(radians), s = sin(radians), k = 1 - c;
+		return Matrix3T(a.x() * a.x() * k + c, a.x() * a.y() * k - a.z() * s, a.x() * a.z() * k + a.y() * s,
+			a.y() * a.x() * k + a.z() * s, a.y() * a.y() * k + c, a.y() * a.z() * k - a.x() * s,
+			a.z() * a.x() * k - a.y() * s, a.z() * a.y() * k + a.x() * s, a.z() * a.z() * k + c);
+	}
+
+	static Matrix3T Scale(const Vec3T<T>& s) {
+		return Matrix3T(s.x(), 0, 0, 0, s.y(), 0, 0, 0, s.z());
+	}
+
 public:
-	double e[9];
+	T e[9];
 };
 
+using Matrix3 = Matrix3T<Real>;
+
 // Utility
 
-std::ostream& operator<<(std::ostream& os, const Matrix3& mat) {
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const Matrix3T<T>& mat) {
 	os << mat.e[0] << " " << mat.e[1] << " " << mat.e[2] << "\n"
 		<< mat.e[3] << " " << mat.e[4] << " " << mat.e[5] << "\n"
 		<< mat.e[6] << " " << mat.e[7] << " " << mat.e[8] << "\n";
 	return os;
 }
 
-inline Matrix3 operator+(const Matrix3& o, const Matrix3& v) {
-	return Matrix3{ o.e[0] + v.e[0], o.e[1] + v.e[1], o.e[2] + v.e[2],
+template <typename T>
+inline Matrix3T<T> operator+(const Matrix3T<T>& o, const Matrix3T<T>& v) {
+	return Matrix3T<T>{ o.e[0] + v.e[0], o.e[1] + v.e[1], o.e[2] + v.e[2],
 					o.e[3] + v.e[3], o.e[4] + v.e[4], o.e[5] + v.e[5],
 					o.e[6] + v.e[6], o.e[7] + v.e[7], o.e[8] + v.e[8] };
 }
 
-inline Matrix3 operator+(const Matrix3& o, double t) {
-	return Matrix3{ o.e[0] + t, o.e[1] + t, o.e[2] + t,
+template <typename T>
+inline Matrix3T<T> operator+(const Matrix3T<T>& o, typename TypeIdentity<T>::type t) {
+	return Matrix3T<T>{ o.e[0] + t, o.e[1] + t, o.e[2] + t,
 					o.e[3] + t, o.e[4] + t, o.e[5] + t,
 					o.e[6] + t, o.e[7] + t, o.e[8] + t };
 }
 
-inline Matrix3 operator-(const Matrix3& o, const Matrix3& v) {
-	return Matrix3{ o.e[0] - v.e[0], o.e[1] - v.e[1], o.e[2] - v.e[2],
+template <typename T>
+inline Matrix3T<T> operator-(const Matrix3T<T>& o, const Matrix3T<T>& v) {
+	return Matrix3T<T>{ o.e[0] - v.e[0], o.e[1] - v.e[1], o.e[2] - v.e[2],
 					o.e[3] - v.e[3], o.e[4] - v.e[4], o.e[5] - v.e[5],
 					o.e[6] - v.e[6], o.e[7] - v.e[7], o.e[8] - v.e[8] };
 }
 
-inline Matrix3 operator-(const Matrix3& o, double t) {
-	return Matrix3{ o.e[0] - t, o.e[1] - t, o.e[2] - t,
+template <typename T>
+inline Matrix3T<T> operator-(const Matrix3T<T>& o, typename TypeIdentity<T>::type t) {
+	return Matrix3T<T>{ o.e[0] - t, o.e[1] - t, o.e[2] - t,
 					o.e[3] - t, o.e[4] - t, o.e[5] - t,
 					o.e[6] - t, o.e[7] - t, o.e[8] - t };
 }
 
-inline Matrix3 operator*(const Matrix3& o, double t) {
-	return Matrix3{ o.e[0] * t, o.e[1] * t, o.e[2] * t,
+template <typename T>
+inline Matrix3T<T> operator*(const Matrix3T<T>& o, typename TypeIdentity<T>::type t) {
+	return Matrix3T<T>{ o.e[0] * t, o.e[1] * t, o.e[2] * t,
 					o.e[3] * t, o.e[4] * t, o.e[5] * t,
 					o.e[6] * t, o.e[7] * t, o.e[8] * t };
 }
 
-inline Matrix3 operator*(double t, const Matrix3& o) {
-	return Matrix3{ t * o.e[0], t * o.e[1], t * o.e[2],
+template <typename T>
+inline Matrix3T<T> operator*(typename TypeIdentity<T>::type t, const Matrix3T<T>& o) {
+	return Matrix3T<T>{ t * o.e[0], t * o.e[1], t * o.e[2],
 					t * o.e[3], t * o.e[4], t * o.e[5],
 					t * o.e[6], t * o.e[7], t * o.e[8] };
 }
 
-inline Matrix3 operator/(const Matrix3& mat, double t) {
+template <typename T>
+inline Matrix3T<T> operator/(const Matrix3T<T>& mat, typename TypeIdentity<T>::type t) {
 	return (1 / t) * mat;
 }
 
-inline Vec3 Dot(const Matrix3& mat, const Vec3& vec) {
-	double x = mat.e[0] * vec.e[0] + mat.e[1] * vec.e[1] + mat.e[2] * vec.e[2];
-	double y = mat.e[3] * vec.e[0] + mat.e[4] * vec.e[1] + mat.e[5] * vec.e[2];
-	double z = mat.e[6] * vec.e[0] + mat.e[7] * vec.e[1] + mat.e[8] * vec.e[2];
-	return Vec3{ x,y,z };
+template <typename T>
+inline Vec3T<T> Dot(const Matrix3T<T>& mat, const Vec3T<T>& vec) {
+	T x = mat.e[0] * vec.e[0] + mat.e[1] * vec.e[1] + mat.e[2] * vec.e[2];
+	T y = mat.e[3] * vec.e[0] + mat.e[4] * vec.e[1] + mat.e[5] * vec.e[2];
+	T z = mat.e[6] * vec.e[0] + mat.e[7] * vec.e[1] + mat.e[8] * vec.e[2];
+	return Vec3T<T>{ x,y,z };
 }
 
-inline double Determinant(const Matrix3& mat) {
-	double det = 0.0;
+template <typename T>
+inline T Determinant(const Matrix3T<T>& mat) {
+	T det = 0;
 
 	// Multipliers
-	double a = mat.e[0], b = mat.e[1], c = mat.e[2];
+	T a = mat.e[0], b = mat.e[1], c = mat.e[2];
 
-	double e = mat.e[4], f = mat.e[5], h = mat.e[7], i = mat.e[8], d = mat.e[3], g = mat.e[6];
+	T e = mat.e[4], f = mat.e[5], h = mat.e[7], i = mat.e[8], d = mat.e[3], g = mat.e[6];
 
 	auto det_a = a * (e * i - f * h);
 	auto det_b = b * (d * i - f * g);
@@ -127,4 +158,92 @@ inline double Determinant(const Matrix3& mat) {
 	return det;
 }
 
+// Product of two matrices: applying a * b is applying b, then a.
+template <typename T>
+inline Matrix3T<T> operator*(const Matrix3T<T>& a, const Matrix3T<T>& b) {
+	Matrix3T<T> m;
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++)
+			m.e[3 * row + col] = a.e[3 * row] * b.e[col] + a.e[3 * row + 1] * b.e[3 + col] + a.e[3 * row + 2] * b.e[6 + col];
+	}
+	return m;
+}
+
+template <typename T>
+inline Matrix3T<T> Transpose(const Matrix3T<T>& mat) {
+	return Matrix3T<T>{ mat.e[0], mat.e[3], mat.e[6],
+					mat.e[1], mat.e[4], mat.e[7],
+					mat.e[2], mat.e[5], mat.e[8] };
+}
+
+// Transpose(mat) times vec, without forming the transpose.
+template <typename T>
+inline Vec3T<T> DotTransposed(const Matrix3T<T>& mat, const Vec3T<T>& vec) {
+	T x = mat.e[0] * vec.e[0] + mat.e[3] * vec.e[1] + mat.e[6] * vec.e[2];
+	T y = mat.e[1] * vec.e[0] + mat.e[4] * vec.e[1] + mat.e[7] * vec.e[2];
+	T z = mat.e[2] * vec.e[0] + mat.e[5] * vec.e[1] + mat.e[8] * vec.e[2];
+	return Vec3T<T>{ x,y,z };
+}
+
+// Inverse through the adjugate. Returns false, leaving inverse unchanged,
+// if mat is singular.
+template <typename T>
+inline bool Inverse(const Matrix3T<T>& mat, Matrix3T<T>& inverse) {
+	T det = Determinant(mat);
+	if (det == 0 || !std::isfinite(det))
+		return false;
+
+	const T* m = mat.e;
+	Matrix3T<T> adjugate{ m[4] * m[8] - m[5] * m[7], m[2] * m[7] - m[1] * m[8], m[1] * m[5] - m[2] * m[4],
+						m[5] * m[6] - m[3] * m[8], m[0] * m[8] - m[2] * m[6], m[2] * m[3] - m[0] * m[5],
+						m[3] * m[7] - m[4] * m[6], m[1] * m[6] - m[0] * m[7], m[0] * m[4] - m[1] * m[3] };
+	inverse = adjugate / det;
+	return true;
+}
+
+// Affine map x -> linear x + translation, for points; vectors only go
+// through linear.
+template <typename T>
+class AffineTransformT {
+public:
+	AffineTransformT() : linear(Matrix3T<T>::Identity()), translation(0, 0, 0) {}
+	AffineTransformT(const Matrix3T<T>& l, const Vec3T<T>& t) : linear(l), translation(t) {}
+
+	static AffineTransformT Translation(const Vec3T<T>& offset) {
+		return AffineTransformT(Matrix3T<T>::Identity(), offset);
+	}
+
+	static AffineTransformT Rotation(const Vec3T<T>& axis, T radians) {
+		return AffineTransformT(Matrix3T<T>::Rotation(axis, radians), Vec3T<T>(0, 0, 0));
+	}
+
+	static AffineTransformT Scale(const Vec3T<T>& s) {
+		return AffineTransformT(Matrix3T<T>::Scale(s), Vec3T<T>(0, 0, 0));
+	}
+
+	Vec3T<T> Point(const Vec3T<T>& p) const { return Dot(linear, p) + translation; }
+	Vec3T<T> Vector(const Vec3T<T>& v) const { return Dot(linear, v); }
+
+public:
+	Matrix3T<T> linear;
+	Vec3T<T> translation;
+};
+
+using AffineTransform = AffineTransformT<Real>;
+
+// Composition: applying a * b is applying b, then a.
+template <typename T>
+inline AffineTransformT<T> operator*(const AffineTransformT<T>& a, const AffineTransformT<T>& b) {
+	return AffineTransformT<T>(a.linear * b.linear, a.Point(b.translation));
+}
+
+template <typename T>
+inline bool Inverse(const AffineTransformT<T>& transform, AffineTransformT<T>& inverse) {
+	Matrix3T<T> linear;
+	if (!Inverse(transform.linear, linear))
+		return false;
+	inverse = AffineTransformT<T>(linear, -Dot(linear, transform.translation));
+	return true;
+}
+
 #endif
@@ -0,0 +1,549 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "triangle_mesh.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Single-pass loaders for Wavefront OBJ and PLY (binary little/big endian and
+// ASCII). Files are parsed straight out of a MappedFile; polygons are
+// triangulated as fans. OBJ `usemtl` names are looked up in `materials`, and
+// faces with unknown or no names get `material`.
+
+using MaterialMap = std::map<std::string, const Material*>;
+
+shared_ptr<TriangleMesh> LoadObj(const std::string& path, const Material* material, const MaterialMap& materials = MaterialMap(), bool use_mapping = true);
+shared_ptr<TriangleMesh> LoadPly(const std::string& path, const Material* material, bool use_mapping = true);
+
+// Picks the loader from the file extension.
+shared_ptr<TriangleMesh> LoadMesh(const std::string& path, const Material* material, const MaterialMap& materials = MaterialMap(), bool use_mapping = true);
+
+// Cursor over a text buffer that is not null-terminated.
+struct TextCursor {
+    const char* p;
+    const char* end;
+
+    void SkipSpaces() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    }
+
+    void SkipLine() {
+        while (p < end && *p != '\n') ++p;
+        if (p < end) ++p;
+    }
+
+    bool AtLineEnd() {
+        SkipSpaces();
+        return p >= end || *p == '\n' || *p == '#';
+    }
+
+    std::string ParseWord() {
+        SkipSpaces();
+        const char* start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') ++p;
+        return std::string(start, p);
+    }
+
+    // Decimal integer, at most INT_MAX in magnitude.
+    bool ParseInt(long& out) {
+        SkipSpaces();
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+        if (p >= end || *p < '0' || *p > '9') return false;
+        long value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            // Fails past INT_MAX rather than overflowing long.
+            if (value > (INT_MAX - (*p - '0')) / 10) return false;
+            value = value * 10 + (*p++ - '0');
+        }
+        out = negative ? -value : value;
+        return true;
+    }
+
+    // Decimal parser; exact for up to 15 significant digits and exponents within 1e22.
+    bool ParseDouble(double& out) {
+        static const double kPow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        SkipSpaces();
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+        uint64_t mantissa = 0;
+        int exponent = 0, digits = 0;
+        bool any = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+            if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; }
+            else exponent++;
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+                if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; exponent--; }
+            }
+        }
+        if (!any) return false;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            long e;
+            if (!ParseInt(e)) return false;
+            // Past 1e+-400 the result is 0 or infinity either way.
+            exponent += static_cast<int>(std::max(-400L, std::min(e, 400L)));
+        }
+
+        double value = static_cast<double>(mantissa);
+        if (exponent < 0)
+            value = exponent >= -22 ? value / kPow10[-exponent] : value * pow(10.0, exponent);
+        else if (exponent > 0)
+            value = exponent <= 22 ? value * kPow10[exponent] : value * pow(10.0, exponent);
+        out = negative ? -value : value;
+        return true;
+    }
+};
+
+// OBJ
+
+struct ObjCorner {
+    int32_t v, vt, vn;
+    bool operator==(const ObjCorner& o) const { return v == o.v && vt == o.vt && vn == o.vn; }
+};
+
+struct ObjCornerHash {
+    size_t operator()(const ObjCorner& c) const {
+        return static_cast<size_t>(MixBits((static_cast<uint64_t>(c.v) << 32) ^ (static_cast<uint64_t>(c.vt) << 16) ^ static_cast<uint64_t>(c.vn)));
+    }
+};
+
+// Resolves a 1-based (or negative, relative) OBJ index to 0-based; -1 if absent or invalid.
+int32_t ResolveObjIndex(long index, size_t count) {
+    if (index > 0 && static_cast<size_t>(index) <= count) return static_cast<int32_t>(index - 1);
+    if (index < 0 && static_cast<size_t>(-index) <= count) return static_cast<int32_t>(count + index);
+    return -1;
+}
+
+shared_ptr<TriangleMesh> LoadObj(const std::string& path, const Material* material, const MaterialMap& materials, bool use_mapping) {
+    MappedFile file;
+    if (!file.Open(path, use_mapping)) {
+        std::cerr << path << ": cannot open file\n";
+        return nullptr;
+    }
+
+    std::vector<Point3> positions;
+    std::vector<Vec3> normals;
+    std::vector<TexCoord> uvs;
+    std::vector<ObjCorner> corners; // three per triangle
+    std::vector<std::pair<uint32_t, std::string>> material_switches;
+    bool has_attributes = false;
+
+    TextCursor in{ file.Data(), file.Data() + file.Size() };
+    std::vector<ObjCorner> polygon;
+    size_t line = 0;
+
+    while (in.p < in.end) {
+        line++;
+        in.SkipSpaces();
+        const char* keyword = in.p;
+        while (in.p < in.end && *in.p != ' ' && *in.p != '\t' && *in.p != '\r' && *in.p != '\n') ++in.p;
+        size_t length = in.p - keyword;
+
+        if (length == 1 && keyword[0] == 'v') {
+            double x, y, z;
+            if (!in.ParseDouble(x) || !in.ParseDouble(y) || !in.ParseDouble(z)) {
+                std::cerr << path << ":" << line << ": malformed vertex\n";
+                return nullptr;
+            }
+            positions.emplace_back(x, y, z);
+        } else if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+            double x, y, z;
+            if (!in.ParseDouble(x) || !in.ParseDouble(y) || !in.ParseDouble(z)) {
+                std::cerr << path << ":" << line << ": malformed normal\n";
+                return nullptr;
+            }
+            normals.emplace_back(x, y, z);
+        } else if (length == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+            double u, v = 0.0;
+            if (!in.ParseDouble(u)) {
+                std::cerr << path << ":" << line << ": malformed texture coordinate\n";
+                return nullptr;
+            }
+            in.ParseDouble(v);
+            uvs.push_back(TexCoord{ Real(u), Real(v) });
+        } else if (length == 1 && keyword[0] == 'f') {
+            polygon.clear();
+            while (!in.AtLineEnd()) {
+                long v, vt = 0, vn = 0;
+                if (!in.ParseInt(v)) {
+                    std::cerr << path << ":" << line << ": malformed face\n";
+                    return nullptr;
+                }
+                if (in.p < in.end && *in.p == '/') {
+                    ++in.p;
+                    if (in.p < in.end && *in.p != '/') in.ParseInt(vt);
+                    if (in.p < in.end && *in.p == '/') { ++in.p; in.ParseInt(vn); }
+                }
+                ObjCorner corner{ ResolveObjIndex(v, positions.size()), ResolveObjIndex(vt, uvs.size()), ResolveObjIndex(vn, normals.size()) };
+                if (corner.v < 0) {
+                    std::cerr << path << ":" << line << ": vertex index out of range\n";
+                    return nullptr;
+                }
+                has_attributes |= corner.vt >= 0 || corner.vn >= 0;
+                polygon.push_back(corner);
+            }
+            for (size_t k = 2; k < polygon.size(); k++) {
+                corners.push_back(polygon[0]);
+                corners.push_back(polygon[k - 1]);
+                corners.push_back(polygon[k]);
+            }
+        } else if (length == 6 && !strncmp(keyword, "usemtl", 6)) {
+            material_switches.emplace_back(static_cast<uint32_t>(corners.size() / 3), in.ParseWord());
+        }
+        in.SkipLine();
+    }
+
+    auto mesh = make_shared<TriangleMesh>();
+    mesh->indices.reserve(corners.size());
+
+    if (!has_attributes) {
+        // Positions only: OBJ indices are the mesh indices.
+        mesh->positions = std::move(positions);
+        for (const auto& corner : corners)
+            mesh->indices.push_back(static_cast<uint32_t>(corner.v));
+    } else {
+        // Every distinct (v, vt, vn) corner becomes one mesh vertex.
+        bool want_normals = !normals.empty(), want_uvs = !uvs.empty();
+        std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> remap;
+        remap.reserve(positions.size());
+        for (const auto& corner : corners) {
+            auto it = remap.find(corner);
+            if (it == remap.end()) {
+                uint32_t index = static_cast<uint32_t>(mesh->positions.size());
+                mesh->positions.push_back(positions[corner.v]);
+                if (want_normals) mesh->normals.push_back(corner.vn >= 0 ? normals[corner.vn] : Vec3(0, 0, 0));
+                if (want_uvs) mesh->uvs.push_back(corner.vt >= 0 ? uvs[corner.vt] : TexCoord{ 0, 0 });
+                it = remap.emplace(corner, index).first;
+            }
+            mesh->indices.push_back(it->second);
+        }
+
+        // Corners without a normal get the face normal's direction from the
+        // geometric normal at hit time; an all-zero normal would produce NaNs.
+        if (want_normals) {
+            for (size_t f = 0; f + 2 < mesh->indices.size(); f += 3) {
+                uint32_t i0 = mesh->indices[f], i1 = mesh->indices[f + 1], i2 = mesh->indices[f + 2];
+                Vec3 n = Cross(mesh->positions[i1] - mesh->positions[i0], mesh->positions[i2] - mesh->positions[i0]);
+                for (uint32_t i : { i0, i1, i2 })
+                    if (mesh->normals[i].NearZero()) mesh->normals[i] = n;
+            }
+        }
+    }
+
+    mesh->SetMaterial(material);
+    for (const auto& entry : material_switches) {
+        auto it = materials.find(entry.second);
+        mesh->AddMaterialRange(entry.first, it != materials.end() ? it->second : material);
+    }
+
+    if (!mesh->Build()) {
+        std::cerr << path << ": more than " << TriangleMesh::kMaxMaterials << " materials\n";
+        return nullptr;
+    }
+    return mesh;
+}
+
+// PLY
+
+enum class PlyType { kInt8, kUint8, kInt16, kUint16, kInt32, kUint32, kFloat32, kFloat64, kInvalid };
+
+PlyType ParsePlyType(const std::string& name) {
+    if (name == "char" || name == "int8") return PlyType::kInt8;
+    if (name == "uchar" || name == "uint8") return PlyType::kUint8;
+    if (name == "short" || name == "int16") return PlyType::kInt16;
+    if (name == "ushort" || name == "uint16") return PlyType::kUint16;
+    if (name == "int" || name == "int32") return PlyType::kInt32;
+    if (name == "uint" || name == "uint32") return PlyType::kUint32;
+    if (name == "float" || name == "float32") return PlyType::kFloat32;
+    if (name == "double" || name == "float64") return PlyType::kFloat64;
+    return PlyType::kInvalid;
+}
+
+size_t PlyTypeSize(PlyType type) {
+    switch (type) {
+    case PlyType::kInt8: case PlyType::kUint8: return 1;
+    case PlyType::kInt16: case PlyType::kUint16: return 2;
+    case PlyType::kInt32: case PlyType::kUint32: case PlyType::kFloat32: return 4;
+    case PlyType::kFloat64: return 8;
+    default: return 0;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::kInvalid;
+    bool is_list = false;
+    PlyType count_type = PlyType::kInvalid;
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+// Reads one binary scalar, swapping bytes when the file endianness differs from the host.
+double ReadPlyScalar(const char* p, PlyType type, bool swap) {
+    unsigned char bytes[8];
+    size_t size = PlyTypeSize(type);
+    for (size_t i = 0; i < size; i++)
+        bytes[i] = static_cast<unsigned char>(p[swap ? size - 1 - i : i]);
+
+    switch (type) {
+    case PlyType::kInt8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+    case PlyType::kUint8: return bytes[0];
+    case PlyType::kInt16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+    case PlyType::kUint16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+    case PlyType::kInt32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+    case PlyType::kUint32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+    case PlyType::kFloat32: { float v; memcpy(&v, bytes, 4); return v; }
+    case PlyType::kFloat64: { double v; memcpy(&v, bytes, 8); return v; }
+    default: return 0.0;
+    }
+}
+
+bool HostIsLittleEndian() {
+    uint16_t probe = 1;
+    unsigned char first;
+    memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+shared_ptr<TriangleMesh> LoadPly(const std::string& path, const Material* material, bool use_mapping) {
+    MappedFile file;
+    if (!file.Open(path, use_mapping)) {
+        std::cerr << path << ": cannot open file\n";
+        return nullptr;
+    }
+
+    TextCursor in{ file.Data(), file.Data() + file.Size() };
+    if (in.ParseWord() != "ply") {
+        std::cerr << path << ": not a PLY file\n";
+        return nullptr;
+    }
+    in.SkipLine();
+
+    // Header
+
+    enum class Format { kAscii, kBinaryLittleEndian, kBinaryBigEndian } format = Format::kAscii;
+    std::vector<PlyElement> elements;
+    bool header_done = false;
+
+    while (in.p < in.end && !header_done) {
+        std::string keyword = in.ParseWord();
+        if (keyword == "format") {
+            std::string name = in.ParseWord();
+            if (name == "ascii") format = Format::kAscii;
+            else if (name == "binary_little_endian") format = Format::kBinaryLittleEndian;
+            else if (name == "binary_big_endian") format = Format::kBinaryBigEndian;
+            else {
+                std::cerr << path << ": unknown PLY format " << name << "\n";
+                return nullptr;
+            }
+        } else if (keyword == "element") {
+            PlyElement element;
+            element.name = in.ParseWord();
+            long count;
+            if (!in.ParseInt(count) || count < 0) {
+                std::cerr << path << ": malformed element\n";
+                return nullptr;
+            }
+            element.count = static_cast<size_t>(count);
+            elements.push_back(element);
+        } else if (keyword == "property" && !elements.empty()) {
+            PlyProperty property;
+            std::string type = in.ParseWord();
+            if (type == "list") {
+                property.is_list = true;
+                property.count_type = ParsePlyType(in.ParseWord());
+                property.type = ParsePlyType(in.ParseWord());
+            } else {
+                property.type = ParsePlyType(type);
+            }
+            property.name = in.ParseWord();
+            if (property.type == PlyType::kInvalid || (property.is_list && property.count_type == PlyType::kInvalid)) {
+                std::cerr << path << ": unsupported property type for " << property.name << "\n";
+                return nullptr;
+            }
+            elements.back().properties.push_back(property);
+        } else if (keyword == "end_header") {
+            header_done = true;
+        }
+        in.SkipLine();
+    }
+
+    if (!header_done) {
+        std::cerr << path << ": missing end_header\n";
+        return nullptr;
+    }
+
+    // Body
+
+    auto mesh = make_shared<TriangleMesh>();
+    bool swap = format == Format::kBinaryBigEndian ? HostIsLittleEndian() : !HostIsLittleEndian();
+    const char* p = in.p;
+    std::vector<double> values;
+    std::vector<uint32_t> polygon;
+
+    // Reads the next scalar of the body, binary or ASCII.
+    auto read_value = [&](PlyType type, double& value) {
+        if (format == Format::kAscii) {
+            in.p = p;
+            while (in.p < in.end && (*in.p == '\n' || *in.p == ' ' || *in.p == '\t' || *in.p == '\r')) ++in.p;
+            bool ok = in.ParseDouble(value);
+            p = in.p;
+            return ok;
+        }
+        size_t size = PlyTypeSize(type);
+        if (static_cast<size_t>(in.end - p) < size)
+            return false;
+        value = ReadPlyScalar(p, type, swap);
+        p += size;
+        return true;
+    };
+
+    for (const auto& element : elements) {
+        bool is_vertex = element.name == "vertex";
+        bool is_face = element.name == "face";
+
+        // Map vertex properties to the slots we keep.
+        enum Slot { kX, kY, kZ, kNx, kNy, kNz, kU, kV, kSlotCount, kSkip = kSlotCount };
+        std::vector<int> slots;
+        bool has_normals = false, has_uvs = false;
+        for (const auto& property : element.properties) {
+            const std::string& n = property.name;
+            int slot = kSkip;
+            if (is_vertex && !property.is_list) {
+                if (n == "x") slot = kX;
+                else if (n == "y") slot = kY;
+                else if (n == "z") slot = kZ;
+                else if (n == "nx") slot = kNx, has_normals = true;
+                else if (n == "ny") slot = kNy;
+                else if (n == "nz") slot = kNz;
+                else if (n == "u" || n == "s" || n == "texture_u") slot = kU, has_uvs = true;
+                else if (n == "v" || n == "t" || n == "texture_v") slot = kV;
+            }
+            slots.push_back(slot);
+        }
+
+        // Every value takes at least one byte, one character in ASCII, so a
+        // count the rest of the file cannot hold is rejected before anything
+        // is reserved for it.
+        size_t min_bytes = 0;
+        for (const auto& property : element.properties)
+            min_bytes += format == Format::kAscii ? 1 : PlyTypeSize(property.is_list ? property.count_type : property.type);
+        size_t bytes_left = static_cast<size_t>(in.end - p);
+        if (element.count > bytes_left / std::max<size_t>(min_bytes, 1)) {
+            std::cerr << path << ": " << element.name << " count " << element.count << " exceeds the data\n";
+            return nullptr;
+        }
+
+        if (is_vertex) {
+            mesh->positions.reserve(element.count);
+            if (has_normals) mesh->normals.reserve(element.count);
+            if (has_uvs) mesh->uvs.reserve(element.count);
+        }
+        if (is_face)
+            mesh->indices.reserve(element.count * 3);
+
+        for (size_t e = 0; e < element.count; e++) {
+            double slot_values[kSlotCount + 1] = {};
+            for (size_t k = 0; k < element.properties.size(); k++) {
+                const auto& property = element.properties[k];
+                if (!property.is_list) {
+                    double value;
+                    if (!read_value(property.type, value)) {
+                        std::cerr << path << ": unexpected end of data in " << element.name << "\n";
+                        return nullptr;
+                    }
+                    slot_values[slots[k]] = value;
+                    continue;
+                }
+
+                double count;
+                if (!read_value(property.count_type, count)) {
+                    std::cerr << path << ": unexpected end of data in " << element.name << "\n";
+                    return nullptr;
+                }
+                if (!(count >= 0) || count != std::floor(count) || count > static_cast<double>(in.end - p)) {
+                    std::cerr << path << ": malformed list count in " << element.name << "\n";
+                    return nullptr;
+                }
+                bool is_indices = is_face && (property.name == "vertex_indices" || property.name == "vertex_index");
+                polygon.clear();
+                for (size_t i = 0; i < static_cast<size_t>(count); i++) {
+                    double value;
+                    if (!read_value(property.type, value)) {
+                        std::cerr << path << ": unexpected end of data in " << element.name << "\n";
+                        return nullptr;
+                    }
+                    if (!is_indices)
+                        continue;
+                    // Range against positions is checked once all elements are read.
+                    if (!(value >= 0) || value > double(UINT32_MAX) || value != std::floor(value)) {
+                        std::cerr << path << ": face index out of range\n";
+                        return nullptr;
+                    }
+                    polygon.push_back(static_cast<uint32_t>(value));
+                }
+                if (is_indices) {
+                    for (size_t i = 2; i < polygon.size(); i++) {
+                        mesh->indices.push_back(polygon[0]);
+                        mesh->indices.push_back(polygon[i - 1]);
+                        mesh->indices.push_back(polygon[i]);
+                    }
+                }
+            }
+
+            if (is_vertex) {
+                mesh->positions.emplace_back(slot_values[kX], slot_values[kY], slot_values[kZ]);
+                if (has_normals) mesh->normals.emplace_back(slot_values[kNx], slot_values[kNy], slot_values[kNz]);
+                if (has_uvs) mesh->uvs.push_back(TexCoord{ Real(slot_values[kU]), Real(slot_values[kV]) });
+            }
+        }
+    }
+
+    for (uint32_t index : mesh->indices) {
+        if (index >= mesh->positions.size()) {
+            std::cerr << path << ": face index out of range\n";
+            return nullptr;
+        }
+    }
+
+    mesh->SetMaterial(material);
+    mesh->Build();
+    return mesh;
+}
+
+shared_ptr<TriangleMesh> LoadMesh(const std::string& path, const Material* material, const MaterialMap& materials, bool use_mapping) {
+    auto dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    for (auto& c : extension)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+
+    if (extension == "obj")
+        return LoadObj(path, material, materials, use_mapping);
+    if (extension == "ply")
+        return LoadPly(path, material, use_mapping);
+
+    std::cerr << path << ": unknown mesh format\n";
+    return nullptr;
+}
+
+#endif // !MESH_LOADER_H
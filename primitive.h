@@ -0,0 +1,36 @@
+#ifndef PRIMITIVE_H
+#define PRIMITIVE_H
+
+#include "hittable.h"
+#include "sphere.h"
+#include "triangle.h"
+
+// Hits object, calling Sphere::Hit and Triangle::Hit directly when type_
+// names them, so they can be inlined into the caller's loop. Every other
+// Hittable, including aggregates such as SpherePack and TriangleMesh, goes
+// through the virtual call. Sphere and Triangle are final, so the tag
+// cannot name a subclass that overrides Hit.
+inline bool HitPrimitive(const Hittable& object, const Ray& r, Real t_min, Real t_max, HitRecord& rec) {
+	switch (object.type_) {
+	case TYPE::SPHERE:
+		return static_cast<const Sphere&>(object).Sphere::Hit(r, t_min, t_max, rec);
+	case TYPE::TRIANGLE:
+		return static_cast<const Triangle&>(object).Triangle::Hit(r, t_min, t_max, rec);
+	default:
+		return object.Hit(r, t_min, t_max, rec);
+	}
+}
+
+// Occlusion counterpart of HitPrimitive.
+inline bool OccludedPrimitive(const Hittable& object, const Ray& r, Real t_min, Real t_max) {
+	switch (object.type_) {
+	case TYPE::SPHERE:
+		return static_cast<const Sphere&>(object).Sphere::Occluded(r, t_min, t_max);
+	case TYPE::TRIANGLE:
+		return static_cast<const Triangle&>(object).Triangle::Occluded(r, t_min, t_max);
+	default:
+		return object.Occluded(r, t_min, t_max);
+	}
+}
+
+#endif // !PRIMITIVE_H
@@ -0,0 +1,268 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "renderer.h"
+#include "image_writer.h"
+#include "mapped_file.h"
+#include "stopwatch.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// Progressive rendering: the whole frame is rendered in passes of
+// pass_samples samples per pixel, summed into the framebuffer. After a pass
+// the sums can be written to a checkpoint, and a killed render resumes from
+// its last checkpoint.
+//
+// Random numbers are keyed by (seed, pixel, sample, bounce) rather than drawn
+// from a running generator, so the random state of a render is just the
+// number of samples taken. Every pixel sums samples 0, 1, 2, ... in order, so
+// a progressive render, resumed or not, matches Render() bit for bit.
+
+struct ProgressiveOptions {
+    int pass_samples = 1;
+    std::string checkpoint_path;    // empty: no checkpoints
+    double checkpoint_interval = 60.0;  // seconds between checkpoints
+    bool resume = false;            // start from checkpoint_path if it exists
+    std::string preview_path;       // written after every pass; empty: none
+    uint64_t scene_id = 0;          // fingerprint of the scene, checked on resume
+};
+
+// Checkpoint layout, native byte order:
+//
+//   char[8]   "RTCKPT2\0"
+//   uint32    byte order mark 0x01020304
+//   uint32    sizeof(Real)
+//   uint32    SamplerType
+//   int32     width, height, max_depth, roulette_depth
+//   uint64    seed, scene_id
+//   int32     samples taken per pixel
+//   int32     samples per pixel the sampler spreads its pattern over, or 0
+//             for the independent sampler, whose samples do not depend on it
+//   Real[]    width * height * 3 sample sums, rows bottom to top
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t real_size;
+    uint32_t sampler;
+    int32_t width, height, max_depth, roulette_depth;
+    uint64_t seed, scene_id;
+    int32_t samples;
+    int32_t pattern_samples;
+};
+
+const char kCheckpointMagic[8] = { 'R', 'T', 'C', 'K', 'P', 'T', '2', '\0' };
+
+// FNV-1a, to fingerprint the scene description in checkpoints.
+inline uint64_t HashString(const std::string& text, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Continues hash over the contents of the file at path. Returns false if it
+// cannot be read.
+inline bool HashFile(const std::string& path, uint64_t& hash) {
+    MappedFile file;
+    if (!file.Open(path))
+        return false;
+    for (size_t i = 0; i < file.Size(); i++) {
+        hash ^= static_cast<unsigned char>(file.Data()[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return true;
+}
+
+CheckpointHeader MakeCheckpointHeader(const RenderSettings& settings, uint64_t scene_id, int samples) {
+    CheckpointHeader header{};
+    std::memcpy(header.magic, kCheckpointMagic, sizeof(header.magic));
+    header.byte_order = 0x01020304;
+    header.real_size = sizeof(Real);
+    header.sampler = static_cast<uint32_t>(settings.sampler);
+    header.width = settings.image_width;
+    header.height = settings.image_height;
+    header.max_depth = settings.max_depth;
+    header.roulette_depth = settings.roulette_depth;
+    header.seed = settings.seed;
+    header.scene_id = scene_id;
+    header.samples = samples;
+    header.pattern_samples = settings.sampler == SamplerType::INDEPENDENT ? 0 : settings.samples_per_pixel;
+    return header;
+}
+
+// Moves the file from onto to, replacing it in one step so that there is
+// always a file at to. POSIX rename() does this; the C runtime's rename() on
+// Windows fails when to exists, so Windows uses MoveFileEx.
+inline bool ReplaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Writes to path.tmp and renames it over path, so a render killed mid-write
+// still leaves the previous checkpoint intact.
+bool WriteCheckpoint(const std::string& path, const RenderSettings& settings, uint64_t scene_id, int samples, const Framebuffer& framebuffer) {
+    CheckpointHeader header = MakeCheckpointHeader(settings, scene_id, samples);
+    std::vector<Real> sums(static_cast<size_t>(framebuffer.Width()) * framebuffer.Height() * 3);
+    Real* p = sums.data();
+    for (int j = 0; j < framebuffer.Height(); ++j) {
+        for (int i = 0; i < framebuffer.Width(); ++i) {
+            const Color& c = framebuffer.At(i, j);
+            *p++ = c.x();
+            *p++ = c.y();
+            *p++ = c.z();
+        }
+    }
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(sums.data()), sums.size() * sizeof(Real));
+        out.close();
+        if (!out) {
+            std::cerr << temp_path << ": write failed\n";
+            return false;
+        }
+    }
+    if (!ReplaceFile(temp_path, path)) {
+        std::cerr << path << ": cannot replace checkpoint\n";
+        return false;
+    }
+    return true;
+}
+
+// Loads a checkpoint written with the same settings and scene. Returns the
+// number of samples it holds per pixel, 0 if there is no checkpoint at path,
+// or -1 if it is unreadable or belongs to a different render.
+int ReadCheckpoint(const std::string& path, const RenderSettings& settings, uint64_t scene_id, Framebuffer& framebuffer) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return 0;
+
+    CheckpointHeader header{};
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    CheckpointHeader expected = MakeCheckpointHeader(settings, scene_id, header.samples);
+    if (!in || std::memcmp(header.magic, kCheckpointMagic, sizeof(header.magic)) != 0 || header.byte_order != expected.byte_order
+        || header.real_size != expected.real_size) {
+        std::cerr << path << ": not a checkpoint of this build\n";
+        return -1;
+    }
+    if (header.width != expected.width || header.height != expected.height || header.max_depth != expected.max_depth
+        || header.roulette_depth != expected.roulette_depth || header.seed != expected.seed || header.sampler != expected.sampler || header.scene_id != expected.scene_id) {
+        std::cerr << path << ": checkpoint of a different scene or settings\n";
+        return -1;
+    }
+    if (header.pattern_samples != expected.pattern_samples) {
+        std::cerr << path << ": checkpoint of a " << header.pattern_samples << "-sample render; the " << SamplerName(settings.sampler)
+                  << " sampler lays out samples for the total count, so resume with --samples " << header.pattern_samples << "\n";
+        return -1;
+    }
+    if (header.samples < 0 || header.samples > settings.samples_per_pixel) {
+        std::cerr << path << ": checkpoint has " << header.samples << " samples per pixel, more than the " << settings.samples_per_pixel << " requested\n";
+        return -1;
+    }
+
+    std::vector<Real> sums(static_cast<size_t>(header.width) * header.height * 3);
+    in.read(reinterpret_cast<char*>(sums.data()), sums.size() * sizeof(Real));
+    if (!in) {
+        std::cerr << path << ": truncated checkpoint\n";
+        return -1;
+    }
+    const Real* p = sums.data();
+    for (int j = 0; j < framebuffer.Height(); ++j) {
+        for (int i = 0; i < framebuffer.Width(); ++i, p += 3)
+            framebuffer.At(i, j) = Color(p[0], p[1], p[2]);
+    }
+    return header.samples;
+}
+
+// Adds samples [first, first + count) of every pixel of the tile to the framebuffer.
+uint64_t RenderTilePass(const Tile& tile, const RenderSettings& settings, const Hittable& world, const Camera& cam, Framebuffer& framebuffer,
+    int first, int count) {
+    uint64_t rays = 0;
+    auto sampler = MakeSampler(settings.sampler, settings.seed, settings.samples_per_pixel);
+    SamplerScope sampler_scope(sampler.get());
+    for (int j = tile.y1 - 1; j >= tile.y0; --j) {
+        for (int i = tile.x0; i < tile.x1; ++i) {
+            Color pixel_color = framebuffer.At(i, j);
+            for (int s = first; s < first + count; ++s)
+                pixel_color += RenderSample(i, j, s, settings, world, cam, *sampler, rays);
+            framebuffer.At(i, j) = pixel_color;
+        }
+    }
+    return rays;
+}
+
+// Renders settings.samples_per_pixel samples per pixel in passes, resuming
+// from and writing checkpoints as options ask. tile_stats sums every pass.
+bool RenderProgressive(const RenderSettings& settings, const ProgressiveOptions& options, const Hittable& world, const Camera& cam,
+    ThreadPool& pool, Framebuffer& framebuffer, std::vector<TileStats>& tile_stats) {
+    auto tiles = GenerateTiles(settings.image_width, settings.image_height, settings.tile_size);
+    tile_stats.assign(tiles.size(), TileStats());
+    int pass_samples = std::max(1, options.pass_samples);
+    STATS_ONLY(StatsBeginImage(settings.image_width, settings.image_height);)
+
+    int samples = 0;
+    if (options.resume && !options.checkpoint_path.empty()) {
+        samples = ReadCheckpoint(options.checkpoint_path, settings, options.scene_id, framebuffer);
+        if (samples < 0)
+            return false;
+        if (samples > 0)
+            std::cerr << "Resuming from " << options.checkpoint_path << " at " << samples << " samples per pixel\n";
+    }
+
+    StopWatch since_checkpoint;
+    since_checkpoint.Begin();
+    while (samples < settings.samples_per_pixel) {
+        int count = std::min(pass_samples, settings.samples_per_pixel - samples);
+        pool.ParallelFor(static_cast<int>(tiles.size()), [&](int index, int worker) {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t rays = RenderTilePass(tiles[index], settings, world, cam, framebuffer, samples, count);
+            auto end = std::chrono::steady_clock::now();
+
+            tile_stats[index].tile = tiles[index];
+            tile_stats[index].worker = worker;
+            tile_stats[index].seconds += std::chrono::duration<double>(end - start).count();
+            tile_stats[index].rays += rays;
+            STATS_ADD(rays, rays);
+        });
+        samples += count;
+
+        if (settings.progress)
+            std::cerr << "\rSamples per pixel: " << samples << '/' << settings.samples_per_pixel << ' ' << std::flush;
+        if (!options.preview_path.empty() && !WriteImage(options.preview_path, framebuffer, samples))
+            return false;
+        bool done = samples == settings.samples_per_pixel;
+        if (!options.checkpoint_path.empty() && (done || since_checkpoint.Stop() >= options.checkpoint_interval)) {
+            if (!WriteCheckpoint(options.checkpoint_path, settings, options.scene_id, samples, framebuffer))
+                return false;
+            since_checkpoint.Begin();
+        }
+    }
+
+    if (settings.progress)
+        std::cerr << "\nDone.\n";
+    return true;
+}
+
+#endif // !PROGRESSIVE_H
@@ -0,0 +1,85 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// PCG32 (XSH-RR) generator: 16 bytes of state, a few cycles per draw and
+// 2^63 selectable streams.
+class Pcg32 {
+public:
+    Pcg32() { Seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+    Pcg32(uint64_t init_state, uint64_t stream) { Seed(init_state, stream); }
+
+    void Seed(uint64_t init_state, uint64_t stream) {
+        state_ = 0u;
+        inc_ = (stream << 1u) | 1u;
+        NextUint();
+        state_ += init_state;
+        NextUint();
+    }
+
+    uint32_t NextUint() {
+        uint64_t old_state = state_;
+        state_ = old_state * 6364136223846793005ULL + inc_;
+        uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+        uint32_t rot = static_cast<uint32_t>(old_state >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+    }
+
+    // Returns a random real in [0,1).
+    double NextDouble() {
+        return NextUint() * (1.0 / 4294967296.0);
+    }
+
+public:
+    uint64_t state_;
+    uint64_t inc_;
+};
+
+// SplitMix64 finalizer, used to turn structured keys into well-spread seeds.
+inline uint64_t MixBits(uint64_t v) {
+    v += 0x9e3779b97f4a7c15ULL;
+    v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+    return v ^ (v >> 31);
+}
+
+// Per-thread random state. The key identifies one camera sample; each bounce
+// of that sample draws from its own PCG stream, so the numbers a path sees do
+// not depend on thread scheduling or on how many draws earlier bounces used.
+struct RandomState {
+    Pcg32 rng;
+    uint64_t key = 0;
+};
+
+inline RandomState& ThreadRandomState() {
+    thread_local RandomState state;
+    return state;
+}
+
+inline uint64_t RandomKey(uint64_t seed, uint64_t pixel, uint64_t sample) {
+    return MixBits(seed + MixBits(pixel + MixBits(sample)));
+}
+
+// Seeds the calling thread's generator for (seed, pixel, sample, bounce).
+inline void SeedRandom(uint64_t seed, uint64_t pixel = 0, uint64_t sample = 0, uint64_t bounce = 0) {
+    auto& state = ThreadRandomState();
+    state.key = RandomKey(seed, pixel, sample);
+    state.rng.Seed(state.key, bounce);
+}
+
+// Seeds the calling thread's generator for a bounce of a sample whose key was
+// saved earlier, so paths can be suspended and resumed in any order.
+inline void SeedRandomKey(uint64_t key, uint64_t bounce) {
+    auto& state = ThreadRandomState();
+    state.key = key;
+    state.rng.Seed(key, bounce);
+}
+
+// Switches to the stream of another bounce of the current (seed, pixel, sample).
+inline void SeedRandomBounce(uint64_t bounce) {
+    auto& state = ThreadRandomState();
+    state.rng.Seed(state.key, bounce);
+}
+
+#endif // !RANDOM_H
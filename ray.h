@@ -3,16 +3,19 @@
 
 #include "vec3.h"
 
-class Ray {
+template <typename T>
+class RayT {
 	public:
-		Ray() : orig(0.0, 0.0, 0.0), dir(0.0, 0.0, 0.0) {}
-		Ray(Point3 origin, Vec3 direction) : orig{ origin }, dir{direction} {}
-		Point3 Origin() const { return orig; }
-		Vec3 Direction() const { return dir; }
-		Point3 At(double t) const { return orig + t * dir; }
+		RayT() : orig(0, 0, 0), dir(0, 0, 0) {}
+		RayT(Vec3T<T> origin, Vec3T<T> direction) : orig{ origin }, dir{direction} {}
+		Vec3T<T> Origin() const { return orig; }
+		Vec3T<T> Direction() const { return dir; }
+		Vec3T<T> At(T t) const { return orig + t * dir; }
 	public:
-		Point3 orig;
-		Vec3 dir;
+		Vec3T<T> orig;
+		Vec3T<T> dir;
 };
 
+using Ray = RayT<Real>;
+
 #endif
\ No newline at end of file
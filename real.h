@@ -0,0 +1,20 @@
+#ifndef REAL_H
+#define REAL_H
+
+// Scalar type of the math core (Vec3, Ray, Matrix3) and everything built on
+// it. Define RAYTRACER_SINGLE_PRECISION for float production renders; the
+// default double build is the reference. See README.md for the error bounds.
+#ifdef RAYTRACER_SINGLE_PRECISION
+using Real = float;
+#else
+using Real = double;
+#endif
+
+// Keeps a template parameter out of deduction, so `2 * v` or `0.5 * v` work
+// for any Vec3T<T> without the literal fixing T.
+template <typename T>
+struct TypeIdentity {
+    using type = T;
+};
+
+#endif // !REAL_H
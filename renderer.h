@@ -0,0 +1,386 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "utility.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "hittable.h"
+#include "lights.h"
+#include "material.h"
+#include "sampler.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct RenderSettings {
+    int image_width = 400;
+    int image_height = 266;
+    int samples_per_pixel = 10;
+    int max_depth = 10;
+    int roulette_depth = 3;     // bounces before Russian roulette may end a path
+    int tile_size = 32;
+    uint64_t seed = 1;
+    SamplerType sampler = SamplerType::INDEPENDENT;
+    bool wavefront = false;     // render tiles with RenderTileWavefront
+    bool adaptive = false;      // render tiles with RenderTileAdaptive; samples_per_pixel is the cap
+    Real noise_threshold = Real(0.01);  // adaptive: display-space standard error at which a pixel stops
+    int min_samples = 8;        // adaptive: samples every pixel takes before it may stop
+    double time_budget = 0.0;   // adaptive: seconds; once spent, pixels stop at min_samples. 0 = none
+    bool progress = true;       // print tiles remaining to std::cerr
+    bool next_event = true;     // sample lights directly at diffuse hits, when there are any
+    const LightSampler* lights = nullptr;   // the scene's lights (Scene::Lights())
+    bool sky = true;            // rays that leave the scene see Background(); else black (Scene::sky)
+};
+
+// Pixel rectangle [x0, x1) x [y0, y1).
+struct Tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+struct TileStats {
+    Tile tile{};
+    int worker = 0;
+    double seconds = 0.0;
+    uint64_t rays = 0;          // camera and scattered rays traced
+};
+
+// Sky color seen by rays that leave the scene.
+Color Background(const Ray& r) {
+    Vec3 unit_direction = UnitVector(r.Direction());
+    auto t = 0.5 * (unit_direction.y() + 1.0);
+    return (1.0 - t) * Color(1.0, 1.0, 1.0) + t * Color(0.5, 0.7, 1.0);
+}
+
+Color MissColor(const RenderSettings& settings, const Ray& r) {
+    return settings.sky ? Background(r) : Color(0, 0, 0);
+}
+
+// Lights sampled at diffuse hits, or nullptr when next-event estimation is off.
+inline const LightSampler* NextEventLights(const RenderSettings& settings) {
+    return settings.next_event && settings.lights && !settings.lights->Empty() ? settings.lights : nullptr;
+}
+
+// Weight of a sample drawn with density f against one drawn with density g
+// (Veach's power heuristic, exponent 2).
+inline Real PowerHeuristic(Real f, Real g) {
+    return f * f / (f * f + g * g);
+}
+
+// Next-event estimation at a Lambertian hit: the light reaching rec.p straight
+// from one point on one light, through the BRDF albedo / pi, weighted against
+// BSDF sampling. Always draws 3 dimensions, so the sample layout does not
+// depend on what the shadow ray finds.
+Color DirectLight(const Hittable& world, const LightSampler& lights, const HitRecord& rec, const Color& albedo) {
+    double select = Sample1D();
+    Point2 u = Sample2D();
+    LightSample sample;
+    if (!lights.Sample(rec.p, select, u, sample))
+        return Color(0, 0, 0);
+    Real cosine = Dot(rec.normal, sample.wi);
+    if (cosine <= 0 || sample.distance <= Real(0.002))
+        return Color(0, 0, 0);
+    STATS_INC(shadow_rays);
+    if (world.Occluded(Ray(rec.p, sample.wi), 0.001, sample.distance - Real(0.001)))
+        return Color(0, 0, 0);
+    Real bsdf_pdf = cosine / Real(pi);
+    return albedo * sample.radiance * (bsdf_pdf * PowerHeuristic(sample.pdf, bsdf_pdf) / sample.pdf);
+}
+
+// Weight of the light a path finds at rec by BSDF sampling: 1 unless the
+// previous vertex also sampled the lights directly, with its BSDF density
+// bsdf_pdf > 0, from the ray's origin.
+inline Real EmissionWeight(const LightSampler* lights, Real bsdf_pdf, const Ray& ray, const HitRecord& rec) {
+    if (!lights || bsdf_pdf <= 0)
+        return 1;
+    return PowerHeuristic(bsdf_pdf, lights->Pdf(ray.Origin(), rec));
+}
+
+// Follows one path iteratively, carrying the product of the attenuations seen
+// so far. From roulette_depth bounces on, a path continues with a probability
+// that follows its throughput and is reweighted to stay unbiased, so dark paths
+// stop early. With roulette_depth >= max_depth every path runs to max_depth.
+//
+// Light is gathered where the path hits an emitter and, at Lambertian hits in
+// scenes with lights, by next-event estimation; multiple importance sampling
+// weights the two so each light path is counted once. Metal and glass are
+// left to BSDF sampling. rays is increased by the number of rays traced.
+Color RayColor(const Ray& r, const Hittable& world, const RenderSettings& settings, uint64_t& rays) {
+    const LightSampler* lights = NextEventLights(settings);
+    HitRecord rec;
+    Ray ray = r;
+    Color throughput(1, 1, 1);
+    Color radiance(0, 0, 0);
+    Real bsdf_pdf = 0;  // of the last bounce, when it was diffuse and lights were sampled there
+
+    for (int bounce = 0; bounce < settings.max_depth; ++bounce) {
+        rays++;
+        if (!world.Hit(ray, 0.001, infinity, rec))
+            return radiance + throughput * MissColor(settings, ray);
+
+        Color emitted;
+        if (EmittedMaterial(*rec.mat_ptr, rec, emitted))
+            radiance += throughput * emitted * EmissionWeight(lights, bsdf_pdf, ray, rec);
+
+        // Bounces are keyed by the remaining depth; the camera ray uses stream 0.
+        SeedRandomBounce(settings.max_depth - bounce);
+        if (Sampler* sampler = ThreadSampler())
+            sampler->StartVertex(bounce);
+        STATS_INC(scatter_calls[static_cast<int>(rec.mat_ptr->type_)]);
+        Ray scattered;
+        Color attenuation;
+        if (!ScatterMaterial(*rec.mat_ptr, ray, rec, attenuation, scattered))
+            return radiance;
+
+        bsdf_pdf = 0;
+        if (lights && rec.mat_ptr->type_ == MaterialType::LAMBERTIAN) {
+            radiance += throughput * DirectLight(world, *lights, rec, attenuation);
+            bsdf_pdf = Dot(rec.normal, UnitVector(scattered.Direction())) / Real(pi);
+        }
+        throughput = throughput * attenuation;
+
+        if (bounce + 1 >= settings.roulette_depth) {
+            Real survive = std::min(Real(0.95), std::max(throughput.x(), std::max(throughput.y(), throughput.z())));
+            if (Sample1D() >= survive)
+                return radiance;
+            throughput /= survive;
+        }
+
+        ray = scattered;
+    }
+
+    // Out of bounces: no more light is gathered.
+    return radiance;
+}
+
+// Splits the image into tiles, top scanlines first so early tiles match the output order.
+std::vector<Tile> GenerateTiles(int image_width, int image_height, int tile_size) {
+    std::vector<Tile> tiles;
+    for (int y1 = image_height; y1 > 0; y1 -= tile_size) {
+        int y0 = std::max(0, y1 - tile_size);
+        for (int x0 = 0; x0 < image_width; x0 += tile_size)
+            tiles.push_back(Tile{ x0, y0, std::min(image_width, x0 + tile_size), y1 });
+    }
+    return tiles;
+}
+
+// Traces sample s of pixel (i, j), drawing from sampler, which must be the
+// thread's sampler. Every sample gets its own random stream, so the image
+// does not depend on tiling, thread count or scheduling order.
+Color RenderSample(int i, int j, int s, const RenderSettings& settings, const Hittable& world, const Camera& cam, Sampler& sampler, uint64_t& rays) {
+    uint64_t pixel = static_cast<uint64_t>(j) * settings.image_width + i;
+    SeedRandom(settings.seed, pixel, s);
+    sampler.StartPixelSample(i, j, s);
+    Point2 jitter = sampler.Get2D();
+    auto u = (i + jitter.x) / (settings.image_width - 1);
+    auto v = (j + jitter.y) / (settings.image_height - 1);
+    Ray r = cam.GetRay(u, v);
+    STATS_ONLY(uint64_t path_start = rays;)
+    Color color = RayColor(r, world, settings, rays);
+    STATS_INC(path_depth[std::min<uint64_t>(rays - path_start, kStatsMaxDepth)]);
+    return color;
+}
+
+// Returns the number of rays traced.
+uint64_t RenderTile(const Tile& tile, const RenderSettings& settings, const Hittable& world, const Camera& cam, Framebuffer& framebuffer) {
+    uint64_t rays = 0;
+    auto sampler = MakeSampler(settings.sampler, settings.seed, settings.samples_per_pixel);
+    SamplerScope sampler_scope(sampler.get());
+    for (int j = tile.y1 - 1; j >= tile.y0; --j) {
+        for (int i = tile.x0; i < tile.x1; ++i) {
+            STATS_ONLY(auto pixel_start = std::chrono::steady_clock::now();)
+            Color pixel_color(0, 0, 0);
+            for (int s = 0; s < settings.samples_per_pixel; ++s)
+                pixel_color += RenderSample(i, j, s, settings, world, cam, *sampler, rays);
+            framebuffer.At(i, j) = pixel_color;
+            STATS_ONLY(StatsRecordPixel(i, j, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - pixel_start).count());)
+        }
+    }
+    return rays;
+}
+
+// Running mean and variance of one pixel's samples, per channel (Welford).
+struct PixelEstimate {
+    Color sum{ 0, 0, 0 };
+    Color mean{ 0, 0, 0 };
+    Color m2{ 0, 0, 0 };
+    int samples = 0;
+
+    void Add(const Color& color) {
+        sum += color;
+        samples++;
+        Color delta = color - mean;
+        mean += delta / Real(samples);
+        m2 += delta * (color - mean);
+    }
+
+    // Standard error of the mean after the gamma-2 output curve, d sqrt(m) =
+    // dm / (2 sqrt(m)), worst channel. The floor keeps near-black pixels from
+    // never converging.
+    Real DisplayError() const {
+        Real error = 0;
+        for (int c = 0; c < 3; c++) {
+            Real standard_error = std::sqrt(m2[c] / (Real(samples - 1) * samples));
+            error = std::max(error, standard_error / (2 * std::sqrt(std::max(mean[c], Real(1e-4)))));
+        }
+        return error;
+    }
+};
+
+// Adaptive sampling. The tile is sampled in rounds: every pixel first takes
+// min_samples, then pixels whose 3x3 neighbourhood (within the tile) still
+// has a display error above noise_threshold take another quarter of what
+// they have, up to samples_per_pixel. Judging a pixel by its neighbours keeps
+// a pixel that happened to miss a rare bright path from stopping early. Flat
+// sky and diffuse regions stop after min_samples; glass, fuzzy metal and
+// edges get the rest of the budget. Pixels add samples 0, 1, 2, ... exactly as
+// in RenderTile, so without a time budget the image is still deterministic.
+uint64_t RenderTileAdaptive(const Tile& tile, const RenderSettings& settings, const Hittable& world, const Camera& cam, Framebuffer& framebuffer,
+    std::chrono::steady_clock::time_point deadline) {
+    uint64_t rays = 0;
+    int width = tile.x1 - tile.x0, height = tile.y1 - tile.y0;
+    int min_samples = std::max(2, std::min(settings.min_samples, settings.samples_per_pixel));
+    std::vector<PixelEstimate> pixels(static_cast<size_t>(width) * height);
+    std::vector<Real> error(pixels.size());
+    std::vector<char> active(pixels.size(), 1);
+    STATS_ONLY(std::vector<double> pixel_ns(pixels.size(), 0.0);)
+    auto sampler = MakeSampler(settings.sampler, settings.seed, settings.samples_per_pixel);
+    SamplerScope sampler_scope(sampler.get());
+
+    for (int round = 0;; round++) {
+        bool any_active = false;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                size_t index = static_cast<size_t>(y) * width + x;
+                if (!active[index])
+                    continue;
+                STATS_ONLY(auto pixel_start = std::chrono::steady_clock::now();)
+                PixelEstimate& pixel = pixels[index];
+                int target = round == 0 ? min_samples : std::min(settings.samples_per_pixel, pixel.samples + std::max(1, pixel.samples / 4));
+                while (pixel.samples < target)
+                    pixel.Add(RenderSample(tile.x0 + x, tile.y0 + y, pixel.samples, settings, world, cam, *sampler, rays));
+                error[index] = pixel.DisplayError();
+                any_active |= pixel.samples < settings.samples_per_pixel;
+                STATS_ONLY(pixel_ns[index] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - pixel_start).count();)
+            }
+        }
+        if (!any_active || (settings.time_budget > 0.0 && std::chrono::steady_clock::now() >= deadline))
+            break;
+
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                size_t index = static_cast<size_t>(y) * width + x;
+                if (!active[index])
+                    continue;
+                Real neighbourhood = 0;
+                for (int ny = std::max(0, y - 1); ny <= std::min(height - 1, y + 1); ++ny)
+                    for (int nx = std::max(0, x - 1); nx <= std::min(width - 1, x + 1); ++nx)
+                        neighbourhood = std::max(neighbourhood, error[static_cast<size_t>(ny) * width + nx]);
+                active[index] = neighbourhood > settings.noise_threshold && pixels[index].samples < settings.samples_per_pixel;
+            }
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t index = static_cast<size_t>(y) * width + x;
+            framebuffer.At(tile.x0 + x, tile.y0 + y) = pixels[index].sum;
+            framebuffer.SampleCount(tile.x0 + x, tile.y0 + y) = pixels[index].samples;
+            STATS_ONLY(StatsRecordPixel(tile.x0 + x, tile.y0 + y, pixel_ns[index]);)
+        }
+    }
+    return rays;
+}
+
+// Batched alternative to RenderTile, defined in wavefront.h.
+uint64_t RenderTileWavefront(const Tile& tile, const RenderSettings& settings, const Hittable& world, const Camera& cam, Framebuffer& framebuffer);
+
+void Render(const RenderSettings& settings, const Hittable& world, const Camera& cam, ThreadPool& pool, Framebuffer& framebuffer, std::vector<TileStats>& tile_stats) {
+    auto tiles = GenerateTiles(settings.image_width, settings.image_height, settings.tile_size);
+    tile_stats.assign(tiles.size(), TileStats());
+    STATS_ONLY(StatsBeginImage(settings.image_width, settings.image_height);)
+    if (settings.adaptive)
+        framebuffer.TrackSampleCounts();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(settings.time_budget));
+
+    std::mutex progress_mutex;
+    int tiles_remaining = static_cast<int>(tiles.size());
+
+    pool.ParallelFor(static_cast<int>(tiles.size()), [&](int index, int worker) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t rays;
+        if (settings.adaptive)
+            rays = RenderTileAdaptive(tiles[index], settings, world, cam, framebuffer, deadline);
+        else if (settings.wavefront)
+            rays = RenderTileWavefront(tiles[index], settings, world, cam, framebuffer);
+        else
+            rays = RenderTile(tiles[index], settings, world, cam, framebuffer);
+        auto end = std::chrono::steady_clock::now();
+
+        tile_stats[index].tile = tiles[index];
+        tile_stats[index].worker = worker;
+        tile_stats[index].seconds = std::chrono::duration<double>(end - start).count();
+        tile_stats[index].rays = rays;
+        STATS_ADD(rays, rays);
+        STATS_ONLY(if (settings.wavefront && !settings.adaptive) StatsRecordTile(tiles[index], tile_stats[index].seconds);)
+
+        if (!settings.progress)
+            return;
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        std::cerr << "\rTiles remaining: " << --tiles_remaining << ' ' << std::flush;
+    });
+
+    if (settings.progress)
+        std::cerr << "\nDone.\n";
+}
+
+// Prints a load-balance summary of the last render and, if csv_path is set, one line per tile.
+void ReportTileStats(const RenderSettings& settings, const std::vector<TileStats>& tile_stats, int num_threads, const std::string& csv_path) {
+    if (tile_stats.empty())
+        return;
+
+    std::vector<double> busy(num_threads, 0.0);
+    std::vector<int> count(num_threads, 0);
+    double min_tile = infinity, max_tile = 0.0, total = 0.0;
+
+    for (const auto& stats : tile_stats) {
+        busy[stats.worker] += stats.seconds;
+        count[stats.worker]++;
+        min_tile = std::min(min_tile, stats.seconds);
+        max_tile = std::max(max_tile, stats.seconds);
+        total += stats.seconds;
+    }
+
+    double mean_busy = total / num_threads;
+    double max_busy = *std::max_element(busy.begin(), busy.end());
+
+    std::cerr << "Tiles: " << tile_stats.size() << " (" << settings.tile_size << "px), threads: " << num_threads << "\n";
+    std::cerr << "  tile ms  min " << 1000.0 * min_tile
+              << "  mean " << 1000.0 * total / tile_stats.size()
+              << "  max " << 1000.0 * max_tile << "\n";
+    for (int t = 0; t < num_threads; ++t)
+        std::cerr << "  thread " << t << ": " << count[t] << " tiles, " << 1000.0 * busy[t] << " ms busy\n";
+    if (mean_busy > 0.0)
+        std::cerr << "  load imbalance (max/mean busy): " << max_busy / mean_busy << "\n";
+
+    if (!csv_path.empty()) {
+        std::ofstream csv(csv_path);
+        csv << "tile,x0,y0,x1,y1,worker,ms\n";
+        for (size_t index = 0; index < tile_stats.size(); ++index) {
+            const auto& stats = tile_stats[index];
+            csv << index << ',' << stats.tile.x0 << ',' << stats.tile.y0 << ',' << stats.tile.x1 << ',' << stats.tile.y1
+                << ',' << stats.worker << ',' << 1000.0 * stats.seconds << '\n';
+        }
+    }
+}
+
+#endif // !RENDERER_H
@@ -0,0 +1,437 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "utility.h"
+#include "sampling.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Samplers hand out the random numbers of one camera sample as numbered
+// dimensions, laid out the same way for every sample of every pixel:
+//
+//   camera   0-1 pixel jitter, 2-3 lens
+//   vertex   kVertexDimensions per bounce: 2 for the BSDF direction, then
+//            1 for a component choice or radius, 3 for next-event estimation
+//            (the light, a point on it), 1 for Russian roulette and 1 spare
+//            to keep the stride even, taken in that order, so a vertex that
+//            skips some draws the rest earlier
+//
+// so dimension d of sample s means the same thing across samples and the
+// sampler can spread the samples of a pixel evenly over it. Draws beyond a
+// vertex's budget come from the bounce's independent random stream.
+//
+//   independent  the bounce's PCG stream; the reference
+//   stratified   Latin hypercube in 1D, correlated multi-jittered (Kensler) in 2D
+//   sobol        Owen-scrambled, shuffled 2D Sobol per dimension pair (Burley)
+//   bluenoise    one Owen-scrambled Sobol sequence for all pixels, rotated per
+//                pixel by a blue-noise mask, so the remaining error is blue noise
+
+enum class SamplerType {
+    INDEPENDENT,
+    STRATIFIED,
+    SOBOL,
+    BLUE_NOISE
+};
+
+class Sampler {
+public:
+    static const int kCameraDimensions = 4;
+    static const int kVertexDimensions = 8;
+
+    Sampler(uint64_t seed, int samples_per_pixel) : seed_(seed), samples_per_pixel_(std::max(1, samples_per_pixel)) {}
+    virtual ~Sampler() = default;
+
+    // Starts sample index of pixel (x, y) at the first camera dimension.
+    void StartPixelSample(int x, int y, int index) {
+        x_ = x;
+        y_ = y;
+        index_ = index;
+        pixel_key_ = MixBits(seed_ + MixBits((static_cast<uint64_t>(y) << 32) | static_cast<uint32_t>(x)));
+        dimension_ = 0;
+        end_ = kCameraDimensions;
+    }
+
+    // Moves to the first dimension of path vertex bounce.
+    void StartVertex(int bounce) {
+        dimension_ = kCameraDimensions + bounce * kVertexDimensions;
+        end_ = dimension_ + kVertexDimensions;
+    }
+
+    double Get1D() {
+        if (dimension_ + 1 > end_)
+            return RandomDouble();
+        return Sample1D(dimension_++);
+    }
+
+    Point2 Get2D() {
+        if (dimension_ + 2 > end_)
+            return Point2{ RandomDouble(), RandomDouble() };
+        Point2 p = Sample2D(dimension_);
+        dimension_ += 2;
+        return p;
+    }
+
+protected:
+    virtual double Sample1D(int dimension) = 0;
+    virtual Point2 Sample2D(int dimension) = 0;
+
+    // Hash of (seed, pixel, dimension), for per-pixel scrambling.
+    uint32_t PixelHash(int dimension) const { return static_cast<uint32_t>(MixBits(pixel_key_ + static_cast<uint64_t>(dimension)) >> 32); }
+
+protected:
+    uint64_t seed_;
+    int samples_per_pixel_;
+    int x_ = 0, y_ = 0, index_ = 0;
+    uint64_t pixel_key_ = 0;
+    int dimension_ = 0;
+    int end_ = kCameraDimensions;
+};
+
+// Sampler the camera and materials on this thread draw from, or nullptr for
+// plain RandomDouble().
+inline Sampler*& ThreadSampler() {
+    thread_local Sampler* sampler = nullptr;
+    return sampler;
+}
+
+inline double Sample1D() {
+    Sampler* sampler = ThreadSampler();
+    return sampler ? sampler->Get1D() : RandomDouble();
+}
+
+inline Point2 Sample2D() {
+    Sampler* sampler = ThreadSampler();
+    if (sampler)
+        return sampler->Get2D();
+    double x = RandomDouble();
+    return Point2{ x, RandomDouble() };
+}
+
+// Installs a sampler as the thread's sampler for the lifetime of the scope.
+class SamplerScope {
+public:
+    explicit SamplerScope(Sampler* sampler) : previous_(ThreadSampler()) { ThreadSampler() = sampler; }
+    ~SamplerScope() { ThreadSampler() = previous_; }
+
+    SamplerScope(const SamplerScope&) = delete;
+    SamplerScope& operator=(const SamplerScope&) = delete;
+
+private:
+    Sampler* previous_;
+};
+
+// Sequence helpers.
+
+inline uint32_t ReverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+inline double ToUnit(uint32_t x) {
+    return x * (1.0 / 4294967296.0);
+}
+
+inline double HashToUnit(uint32_t index, uint32_t seed) {
+    return ToUnit(static_cast<uint32_t>(MixBits((static_cast<uint64_t>(seed) << 32) | index) >> 32));
+}
+
+// Random permutation of [0, length) selected by seed (Kensler, "Correlated
+// Multi-Jittered Sampling", 2013).
+inline uint32_t PermuteIndex(uint32_t i, uint32_t length, uint32_t seed) {
+    uint32_t w = length - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= length);
+    return (i + seed) % length;
+}
+
+// Owen scrambling by hashing (Burley, "Practical Hash-based Owen Scrambling",
+// 2020). The Laine-Karras permutation scrambles a bit-reversed value; the
+// reversals are kept outside so SobolSample2D can cancel pairs of them.
+inline uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline uint32_t NestedUniformScramble(uint32_t x, uint32_t seed) {
+    return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+}
+
+// Point index of the shuffled, Owen-scrambled 2D Sobol sequence; the first
+// two Sobol dimensions form a (0,2)-sequence, so every power-of-two prefix is
+// stratified in all elementary intervals.
+inline Point2 SobolSample2D(uint32_t index, uint32_t seed) {
+    // Second Sobol dimension, bit-reversed, a byte of the index at a time:
+    // table k holds the XOR of the reversed generator matrix columns
+    // 8k..8k+7 selected by each byte value.
+    static const std::array<std::array<uint32_t, 256>, 4> kSobol1 = [] {
+        std::array<std::array<uint32_t, 256>, 4> tables{};
+        uint32_t columns[32];
+        for (uint32_t c = 0, v = 1u << 31; c < 32; c++, v ^= v >> 1)
+            columns[c] = ReverseBits(v);
+        for (int k = 0; k < 4; k++)
+            for (uint32_t byte = 0; byte < 256; byte++)
+                for (int bit = 0; bit < 8; bit++)
+                    if (byte & (1u << bit))
+                        tables[k][byte] ^= columns[8 * k + bit];
+        return tables;
+    }();
+
+    // The first dimension is the bit-reversed index, so its scramble needs no
+    // reversal going in; the table output needs none either.
+    index = NestedUniformScramble(index, seed);
+    uint32_t y = kSobol1[0][index & 0xff] ^ kSobol1[1][(index >> 8) & 0xff] ^ kSobol1[2][(index >> 16) & 0xff] ^ kSobol1[3][index >> 24];
+    uint32_t x = ReverseBits(LaineKarrasPermutation(index, static_cast<uint32_t>(MixBits(seed))));
+    y = ReverseBits(LaineKarrasPermutation(y, static_cast<uint32_t>(MixBits(seed + 1))));
+    return Point2{ ToUnit(x), ToUnit(y) };
+}
+
+// Samplers.
+
+class IndependentSampler : public Sampler {
+public:
+    using Sampler::Sampler;
+
+protected:
+    double Sample1D(int) override { return RandomDouble(); }
+
+    Point2 Sample2D(int) override {
+        double x = RandomDouble();
+        return Point2{ x, RandomDouble() };
+    }
+};
+
+class StratifiedSampler : public Sampler {
+public:
+    using Sampler::Sampler;
+
+protected:
+    // One sample per 1/n slice, slices shuffled per pixel and dimension.
+    double Sample1D(int dimension) override {
+        uint32_t n = samples_per_pixel_;
+        uint32_t seed = PixelHash(dimension);
+        uint32_t s = index_ % n;
+        return (PermuteIndex(s, n, seed) + HashToUnit(s, seed * 0x967a889bu)) / n;
+    }
+
+    // Stratified in an m x n grid and in both 1D projections.
+    Point2 Sample2D(int dimension) override {
+        uint32_t count = samples_per_pixel_;
+        uint32_t m = static_cast<uint32_t>(std::sqrt(static_cast<double>(count)));
+        uint32_t n = (count + m - 1) / m;
+        uint32_t seed = PixelHash(dimension);
+        uint32_t s = PermuteIndex(index_ % count, count, seed * 0x51633e2du);
+        uint32_t sx = PermuteIndex(s % m, m, seed * 0x68bc21ebu);
+        uint32_t sy = PermuteIndex(s / m, n, seed * 0x02e5be93u);
+        double jx = HashToUnit(s, seed * 0x967a889bu);
+        double jy = HashToUnit(s, seed * 0x368cc8b7u);
+        return Point2{ (sx + (sy + jx) / n) / m, (s + jy) / count };
+    }
+};
+
+class SobolSampler : public Sampler {
+public:
+    using Sampler::Sampler;
+
+protected:
+    double Sample1D(int dimension) override { return SobolSample2D(index_, PixelHash(dimension)).x; }
+    Point2 Sample2D(int dimension) override { return SobolSample2D(index_, PixelHash(dimension)); }
+};
+
+// 64 x 64 tileable blue-noise mask of values in [0,1), made once by
+// void-and-cluster (Ulichney 1993) with a Gaussian of sigma 1.5.
+class BlueNoiseMask {
+public:
+    static const int kSize = 64;
+
+    static const BlueNoiseMask& Get() {
+        static const BlueNoiseMask mask;
+        return mask;
+    }
+
+    double At(int x, int y) const { return values_[(y & (kSize - 1)) * kSize + (x & (kSize - 1))]; }
+
+private:
+    BlueNoiseMask();
+
+    std::vector<double> values_;
+};
+
+BlueNoiseMask::BlueNoiseMask() {
+    const int n = kSize * kSize;
+    const double kSigma = 1.5;
+    std::vector<double> kernel(n);
+    for (int y = 0; y < kSize; y++) {
+        for (int x = 0; x < kSize; x++) {
+            int dx = std::min(x, kSize - x), dy = std::min(y, kSize - y);
+            kernel[y * kSize + x] = std::exp(-(dx * dx + dy * dy) / (2 * kSigma * kSigma));
+        }
+    }
+
+    std::vector<char> on(n, 0);
+    std::vector<double> energy(n, 0.0);
+    auto splat = [&](int p, double sign) {
+        int px = p % kSize, py = p / kSize;
+        for (int y = 0; y < kSize; y++) {
+            const double* row = &kernel[((y - py) & (kSize - 1)) * kSize];
+            for (int x = 0; x < kSize; x++)
+                energy[y * kSize + x] += sign * row[(x - px) & (kSize - 1)];
+        }
+    };
+    auto tightest_cluster = [&] {
+        int best = -1;
+        for (int p = 0; p < n; p++)
+            if (on[p] && (best < 0 || energy[p] > energy[best]))
+                best = p;
+        return best;
+    };
+    auto largest_void = [&] {
+        int best = -1;
+        for (int p = 0; p < n; p++)
+            if (!on[p] && (best < 0 || energy[p] < energy[best]))
+                best = p;
+        return best;
+    };
+
+    // Initial pattern: a tenth of the pixels at random, then relaxed by moving
+    // the tightest cluster into the largest void until that changes nothing.
+    Pcg32 rng(0x5eed, 7);
+    int initial = n / 10;
+    for (int placed = 0; placed < initial;) {
+        int p = static_cast<int>(rng.NextUint() % n);
+        if (on[p])
+            continue;
+        on[p] = 1;
+        splat(p, 1.0);
+        placed++;
+    }
+    for (int iteration = 0; iteration < n; iteration++) {
+        int cluster = tightest_cluster();
+        on[cluster] = 0;
+        splat(cluster, -1.0);
+        int hole = largest_void();
+        on[hole] = 1;
+        splat(hole, 1.0);
+        if (hole == cluster)
+            break;
+    }
+    std::vector<char> initial_on = on;
+    std::vector<double> initial_energy = energy;
+
+    // Ranks: the initial points by removing clusters, the rest by filling voids.
+    std::vector<int> rank(n, 0);
+    for (int r = initial - 1; r >= 0; r--) {
+        int cluster = tightest_cluster();
+        on[cluster] = 0;
+        splat(cluster, -1.0);
+        rank[cluster] = r;
+    }
+    on = initial_on;
+    energy = initial_energy;
+    for (int r = initial; r < n; r++) {
+        int hole = largest_void();
+        on[hole] = 1;
+        splat(hole, 1.0);
+        rank[hole] = r;
+    }
+
+    values_.resize(n);
+    for (int p = 0; p < n; p++)
+        values_[p] = (rank[p] + 0.5) / n;
+}
+
+class BlueNoiseSampler : public Sampler {
+public:
+    BlueNoiseSampler(uint64_t seed, int samples_per_pixel) : Sampler(seed, samples_per_pixel), mask_(BlueNoiseMask::Get()) {}
+
+protected:
+    double Sample1D(int dimension) override { return Sample2D(dimension).x; }
+
+    Point2 Sample2D(int dimension) override {
+        uint32_t seed = static_cast<uint32_t>(MixBits(seed_ + static_cast<uint64_t>(dimension)) >> 32);
+        Point2 p = SobolSample2D(index_, seed);
+        // Toroidal shifts decorrelate the rotation of different dimensions.
+        double rx = mask_.At(x_ + static_cast<int>(seed & 63), y_ + static_cast<int>((seed >> 6) & 63));
+        double ry = mask_.At(x_ + static_cast<int>((seed >> 12) & 63), y_ + static_cast<int>((seed >> 18) & 63));
+        p.x += rx;
+        p.y += ry;
+        return Point2{ p.x - std::floor(p.x), p.y - std::floor(p.y) };
+    }
+
+private:
+    const BlueNoiseMask& mask_;
+};
+
+std::unique_ptr<Sampler> MakeSampler(SamplerType type, uint64_t seed, int samples_per_pixel) {
+    switch (type) {
+    case SamplerType::STRATIFIED:
+        return std::make_unique<StratifiedSampler>(seed, samples_per_pixel);
+    case SamplerType::SOBOL:
+        return std::make_unique<SobolSampler>(seed, samples_per_pixel);
+    case SamplerType::BLUE_NOISE:
+        return std::make_unique<BlueNoiseSampler>(seed, samples_per_pixel);
+    default:
+        return std::make_unique<IndependentSampler>(seed, samples_per_pixel);
+    }
+}
+
+const char* SamplerName(SamplerType type) {
+    switch (type) {
+    case SamplerType::STRATIFIED:
+        return "stratified";
+    case SamplerType::SOBOL:
+        return "sobol";
+    case SamplerType::BLUE_NOISE:
+        return "bluenoise";
+    default:
+        return "independent";
+    }
+}
+
+bool ParseSamplerType(const std::string& name, SamplerType& type) {
+    for (SamplerType t : { SamplerType::INDEPENDENT, SamplerType::STRATIFIED, SamplerType::SOBOL, SamplerType::BLUE_NOISE }) {
+        if (name == SamplerName(t)) {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // !SAMPLER_H
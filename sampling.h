@@ -0,0 +1,222 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "utility.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Closed-form warps from uniform numbers in [0,1) to the shapes the renderer
+// samples. Each one consumes a fixed number of dimensions, so a stratified or
+// low-discrepancy sampler keeps its structure through the warp.
+
+struct Point2 {
+    double x, y;
+};
+
+// sin and cos of a in [-pi/4, pi/4] by their Taylor series to degree 11 and
+// 12; the truncation error is below 1e-11. Written out so the batch warps
+// below can evaluate it on SimdPacks with the same operations.
+const double kSinCoefficients[6] = { 1.0, -1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880, -1.0 / 39916800 };
+const double kCosCoefficients[7] = { 1.0, -1.0 / 2, 1.0 / 24, -1.0 / 720, 1.0 / 40320, -1.0 / 3628800, 1.0 / 479001600 };
+
+inline void SinCosQuarterPi(double a, double& s, double& c) {
+    double a2 = a * a;
+    s = kSinCoefficients[5];
+    for (int k = 4; k >= 0; k--)
+        s = s * a2 + kSinCoefficients[k];
+    s *= a;
+    c = kCosCoefficients[6];
+    for (int k = 5; k >= 0; k--)
+        c = c * a2 + kCosCoefficients[k];
+}
+
+// Uniform in the unit disk (z = 0), by Shirley and Chiu's concentric mapping,
+// which keeps strata of the square compact on the disk. Two draws, no loop.
+inline Vec3 SampleUnitDisk(Point2 u) {
+    double a = 2 * u.x - 1, b = 2 * u.y - 1;
+    if (a == 0 && b == 0)
+        return Vec3(0, 0, 0);
+    // The angle is pi/4 * (b/a) in the sectors left and right of the centre
+    // and pi/2 - pi/4 * (a/b) above and below it, which swaps sin and cos.
+    bool horizontal = a * a > b * b;
+    double r = horizontal ? a : b;
+    double s, c;
+    SinCosQuarterPi((pi / 4) * (horizontal ? b / a : a / b), s, c);
+    return horizontal ? Vec3(Real(r * c), Real(r * s), 0) : Vec3(Real(r * s), Real(r * c), 0);
+}
+
+// Cosine-weighted direction on the hemisphere around +z (Malley's method:
+// lift a uniform disk point onto the hemisphere).
+inline Vec3 SampleCosineHemisphere(Point2 u) {
+    Vec3 d = SampleUnitDisk(u);
+    Real z = std::sqrt(std::max(Real(0), 1 - d.x() * d.x() - d.y() * d.y()));
+    return Vec3(d.x(), d.y(), z);
+}
+
+// Uniform on the unit sphere. A uniform disk point at radius r maps to height
+// 1 - 2 r^2, which is uniform in [-1, 1], at the same azimuth.
+inline Vec3 SampleUnitSphere(Point2 u) {
+    Vec3 d = SampleUnitDisk(u);
+    Real r2 = d.x() * d.x() + d.y() * d.y();
+    Real scale = 2 * std::sqrt(std::max(Real(0), 1 - r2));
+    return Vec3(d.x() * scale, d.y() * scale, 1 - 2 * r2);
+}
+
+// Uniform in the unit ball: a direction on the sphere and a radius with
+// density proportional to r^2.
+inline Vec3 SampleUnitBall(Point2 u, Real w) {
+    return std::cbrt(w) * SampleUnitSphere(u);
+}
+
+// Orthonormal basis around a unit vector (Duff et al., "Building an
+// Orthonormal Basis, Revisited", 2017).
+struct Onb {
+    explicit Onb(const Vec3& n) : w(n) {
+        Real sign = std::copysign(Real(1), n.z());
+        Real a = -1 / (sign + n.z());
+        Real b = n.x() * n.y() * a;
+        u = Vec3(1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+        v = Vec3(b, sign + n.y() * n.y() * a, -n.y());
+    }
+
+    Vec3 Local(const Vec3& a) const { return a.x() * u + a.y() * v + a.z() * w; }
+
+    Vec3 u, v, w;
+};
+
+// The renderer's random helpers, now closed-form: a fixed number of draws
+// from RandomDouble() each.
+
+inline Point2 RandomPoint2() {
+    double x = RandomDouble();
+    return Point2{ x, RandomDouble() };
+}
+
+inline Vec3 RandomInUnitSphere() {
+    Point2 u = RandomPoint2();
+    return SampleUnitBall(u, Real(RandomDouble()));
+}
+
+inline Vec3 RandomUnitVectorInSphere() {
+    return SampleUnitSphere(RandomPoint2());
+}
+
+// Unit vector in the xy plane.
+inline Vec3 RandomUnitVectorInPlane() {
+    Vec3 d = SampleUnitDisk(RandomPoint2());
+    Real length = d.Length();
+    return length > 0 ? d / length : Vec3(1, 0, 0);
+}
+
+inline Vec3 RandomInHemisphere(const Vec3& normal) {
+    Vec3 in_unit_sphere = RandomInUnitSphere();
+    return Dot(in_unit_sphere, normal) > 0 ? in_unit_sphere : -in_unit_sphere;
+}
+
+inline Vec3 RandomInUnitDisk() {
+    return SampleUnitDisk(RandomPoint2());
+}
+
+// Batch warps over structure-of-arrays input, SimdPack<Real>::kWidth points
+// per step; they compute the same mapping as the scalar warps above, without
+// branches. Outputs may alias inputs.
+
+template <typename P>
+inline void ConcentricDiskLanes(P u, P v, P& x, P& y) {
+    P one = P::Set1(1), zero = P::Set1(0);
+    P a = P::Set1(2) * u - one, b = P::Set1(2) * v - one;
+    auto vertical = P::CmpLe(a * a, b * b);
+    P r = P::Select(vertical, b, a);
+    P numerator = P::Select(vertical, a, b);
+    auto centre = P::And(P::CmpGe(r, zero), P::CmpLe(r, zero));
+    P t = numerator / P::Select(centre, one, r);
+
+    P angle = P::Set1(pi / 4) * t;
+    P a2 = angle * angle;
+    P s = P::Set1(kSinCoefficients[5]);
+    for (int k = 4; k >= 0; k--)
+        s = s * a2 + P::Set1(kSinCoefficients[k]);
+    s = s * angle;
+    P c = P::Set1(kCosCoefficients[6]);
+    for (int k = 5; k >= 0; k--)
+        c = c * a2 + P::Set1(kCosCoefficients[k]);
+
+    x = r * P::Select(vertical, s, c);
+    y = r * P::Select(vertical, c, s);
+}
+
+inline bool IsPackAligned(const Real* p) {
+    return reinterpret_cast<uintptr_t>(p) % sizeof(SimdPack<Real>) == 0;
+}
+
+// Runs kernel(u, v, outputs...) over count points, kWidth at a time. Full
+// packs of aligned arrays are loaded and stored in place; a ragged tail, or
+// arrays without pack alignment, go through aligned scratch lanes.
+template <int kOutputs, typename Kernel>
+void WarpBatch(const Real* u, const Real* v, Real* const (&out)[kOutputs], int count, Kernel kernel) {
+    using P = SimdPack<Real>;
+    const int w = P::kWidth;
+    int i = 0;
+    bool aligned = IsPackAligned(u) && IsPackAligned(v);
+    for (int o = 0; o < kOutputs; o++)
+        aligned = aligned && IsPackAligned(out[o]);
+    if (aligned) {
+        for (; i + w <= count; i += w) {
+            P results[kOutputs];
+            kernel(P::Load(u + i), P::Load(v + i), results);
+            for (int o = 0; o < kOutputs; o++)
+                results[o].Store(out[o] + i);
+        }
+    }
+
+    alignas(64) Real lanes[2 + kOutputs][P::kWidth];
+    for (; i < count; i += w) {
+        int n = std::min(w, count - i);
+        for (int k = 0; k < w; k++) {
+            lanes[0][k] = k < n ? u[i + k] : Real(0.5);
+            lanes[1][k] = k < n ? v[i + k] : Real(0.5);
+        }
+        P results[kOutputs];
+        kernel(P::Load(lanes[0]), P::Load(lanes[1]), results);
+        for (int o = 0; o < kOutputs; o++) {
+            results[o].Store(lanes[2 + o]);
+            for (int k = 0; k < n; k++)
+                out[o][i + k] = lanes[2 + o][k];
+        }
+    }
+}
+
+void SampleUnitDiskBatch(const Real* u, const Real* v, Real* x, Real* y, int count) {
+    using P = SimdPack<Real>;
+    Real* const out[2] = { x, y };
+    WarpBatch<2>(u, v, out, count, [](P pu, P pv, P* r) { ConcentricDiskLanes(pu, pv, r[0], r[1]); });
+}
+
+void SampleCosineHemisphereBatch(const Real* u, const Real* v, Real* x, Real* y, Real* z, int count) {
+    using P = SimdPack<Real>;
+    Real* const out[3] = { x, y, z };
+    WarpBatch<3>(u, v, out, count, [](P pu, P pv, P* r) {
+        ConcentricDiskLanes(pu, pv, r[0], r[1]);
+        P h = P::Set1(1) - r[0] * r[0] - r[1] * r[1];
+        r[2] = P::Sqrt(P::Select(P::CmpGe(h, P::Set1(0)), h, P::Set1(0)));
+    });
+}
+
+void SampleUnitSphereBatch(const Real* u, const Real* v, Real* x, Real* y, Real* z, int count) {
+    using P = SimdPack<Real>;
+    Real* const out[3] = { x, y, z };
+    WarpBatch<3>(u, v, out, count, [](P pu, P pv, P* r) {
+        ConcentricDiskLanes(pu, pv, r[0], r[1]);
+        P r2 = r[0] * r[0] + r[1] * r[1];
+        P h = P::Set1(1) - r2;
+        P scale = P::Set1(2) * P::Sqrt(P::Select(P::CmpGe(h, P::Set1(0)), h, P::Set1(0)));
+        r[0] = r[0] * scale;
+        r[1] = r[1] * scale;
+        r[2] = P::Set1(1) - P::Set1(2) * r2;
+    });
+}
+
+#endif // !SAMPLING_H
@@ -0,0 +1,168 @@
+#ifndef SAMPLING_BENCHMARK_H
+#define SAMPLING_BENCHMARK_H
+
+#include "utility.h"
+#include "sampling.h"
+#include "stopwatch.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Microbenchmark of the sampling routines: the rejection loops the renderer
+// used before the closed-form warps of sampling.h, against those warps,
+// scalar and batched. Every routine draws its own numbers from the PCG
+// generator, so the timings include the draws it needs. Batches run over
+// kSamplingChunk points at a time, which stay in L1, as a wavefront batch would.
+
+// The previous routines, kept here for comparison. draws counts RandomDouble() calls.
+inline Vec3 RejectionInUnitSphere(uint64_t& draws) {
+    while (true) {
+        draws += 3;
+        Vec3 p = Vec3(Real(RandomDouble(-1, 1)), Real(RandomDouble(-1, 1)), Real(RandomDouble(-1, 1)));
+        if (p.LengthSquared() >= 1) continue;
+        return p;
+    }
+}
+
+inline Vec3 RejectionInUnitDisk(uint64_t& draws) {
+    while (true) {
+        draws += 2;
+        auto p = Vec3(Real(RandomDouble(-1, 1)), Real(RandomDouble(-1, 1)), 0);
+        if (p.LengthSquared() >= 1) continue;
+        return p;
+    }
+}
+
+const int kSamplingChunk = 1024;
+
+struct SamplingTiming {
+    std::string name;
+    double ns_per_sample = 0.0;
+    double draws_per_sample = 0.0;
+};
+
+// Runs fn(count, draws) runs times and keeps the fastest; fn returns a checksum
+// so the work cannot be optimized away.
+template <typename Fn>
+SamplingTiming TimeSampling(const std::string& name, int count, int runs, Fn fn, double& checksum) {
+    SamplingTiming timing;
+    timing.name = name;
+    double best = infinity;
+    for (int run = 0; run < runs; run++) {
+        SeedRandom(1);
+        uint64_t draws = 0;
+        StopWatch stop_watch;
+        stop_watch.Begin();
+        checksum += fn(count, draws);
+        best = std::min(best, static_cast<double>(stop_watch.ElapsedNanoseconds()));
+        timing.draws_per_sample = double(draws) / count;
+    }
+    timing.ns_per_sample = best / count;
+    return timing;
+}
+
+void RunSamplingBenchmark(std::ostream& out, int count = 1 << 20, int runs = 5) {
+    std::vector<SamplingTiming> timings;
+    double checksum = 0.0;
+    alignas(64) static Real u[kSamplingChunk], v[kSamplingChunk], x[kSamplingChunk], y[kSamplingChunk], z[kSamplingChunk];
+    const Vec3 normal = UnitVector(Vec3(1, 2, 3));
+
+    auto sum = [](const Vec3& p) { return double(p.x() + p.y() + p.z()); };
+
+    // Batches draw their uniforms up front, as a wavefront kernel would, then
+    // warp them; warp(m) maps the first m points.
+    auto batch = [&](int n, uint64_t& draws, bool with_z, auto warp) {
+        double s = 0.0;
+        for (int first = 0; first < n; first += kSamplingChunk) {
+            int m = std::min(kSamplingChunk, n - first);
+            for (int i = 0; i < m; i++) {
+                u[i] = Real(RandomDouble());
+                v[i] = Real(RandomDouble());
+            }
+            warp(m);
+            for (int i = 0; i < m; i++)
+                s += x[i] + y[i] + (with_z ? z[i] : 0);
+        }
+        draws += 2 * static_cast<uint64_t>(n);
+        return s;
+    };
+
+    timings.push_back(TimeSampling("disk, rejection", count, runs, [&](int n, uint64_t& draws) {
+        double s = 0.0;
+        for (int i = 0; i < n; i++)
+            s += sum(RejectionInUnitDisk(draws));
+        return s;
+    }, checksum));
+    timings.push_back(TimeSampling("disk, concentric", count, runs, [&](int n, uint64_t& draws) {
+        double s = 0.0;
+        for (int i = 0; i < n; i++)
+            s += sum(SampleUnitDisk(RandomPoint2()));
+        draws += 2 * static_cast<uint64_t>(n);
+        return s;
+    }, checksum));
+    timings.push_back(TimeSampling("disk, concentric batch", count, runs, [&](int n, uint64_t& draws) {
+        return batch(n, draws, false, [&](int m) { SampleUnitDiskBatch(u, v, x, y, m); });
+    }, checksum));
+
+    timings.push_back(TimeSampling("sphere, rejection + normalize", count, runs, [&](int n, uint64_t& draws) {
+        double s = 0.0;
+        for (int i = 0; i < n; i++)
+            s += sum(UnitVector(RejectionInUnitSphere(draws)));
+        return s;
+    }, checksum));
+    timings.push_back(TimeSampling("sphere, closed form", count, runs, [&](int n, uint64_t& draws) {
+        double s = 0.0;
+        for (int i = 0; i < n; i++)
+            s += sum(SampleUnitSphere(RandomPoint2()));
+        draws += 2 * static_cast<uint64_t>(n);
+        return s;
+    }, checksum));
+    timings.push_back(TimeSampling("sphere, closed form batch", count, runs, [&](int n, uint64_t& draws) {
+        return batch(n, draws, true, [&](int m) { SampleUnitSphereBatch(u, v, x, y, z, m); });
+    }, checksum));
+
+    timings.push_back(TimeSampling("ball, rejection", count, runs, [&](int n, uint64_t& draws) {
+        double s = 0.0;
+        for (int i = 0; i < n; i++)
+            s += sum(RejectionInUnitSphere(draws));
+        return s;
+    }, checksum));
+    timings.push_back(TimeSampling("ball, closed form", count, runs, [&](int n, uint64_t& draws) {
+        double s = 0.0;
+        for (int i = 0; i < n; i++)
+            s += sum(RandomInUnitSphere());
+        draws += 3 * static_cast<uint64_t>(n);
+        return s;
+    }, checksum));
+
+    timings.push_back(TimeSampling("cosine, normal + rejection", count, runs, [&](int n, uint64_t& draws) {
+        double s = 0.0;
+        for (int i = 0; i < n; i++)
+            s += sum(normal + UnitVector(RejectionInUnitSphere(draws)));
+        return s;
+    }, checksum));
+    timings.push_back(TimeSampling("cosine, concentric + basis", count, runs, [&](int n, uint64_t& draws) {
+        double s = 0.0;
+        for (int i = 0; i < n; i++)
+            s += sum(Onb(normal).Local(SampleCosineHemisphere(RandomPoint2())));
+        draws += 2 * static_cast<uint64_t>(n);
+        return s;
+    }, checksum));
+    timings.push_back(TimeSampling("cosine, concentric batch", count, runs, [&](int n, uint64_t& draws) {
+        return batch(n, draws, true, [&](int m) { SampleCosineHemisphereBatch(u, v, x, y, z, m); });
+    }, checksum));
+
+    out << "Sampling routines, " << count << " samples, best of " << runs << " runs (SIMD width " << SimdPack<Real>::kWidth << "):\n";
+    out << std::fixed;
+    for (const auto& timing : timings) {
+        out << "  " << std::left << std::setw(32) << timing.name << std::right << std::setprecision(2)
+            << std::setw(8) << timing.ns_per_sample << " ns" << std::setw(8) << timing.draws_per_sample << " draws\n";
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6) << "  (checksum " << checksum << ")\n";
+}
+
+#endif // !SAMPLING_BENCHMARK_H
@@ -0,0 +1,122 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "arena.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "lights.h"
+#include "material.h"
+#include "bvh.h"
+#include "sphere_pack.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Owns everything a render reads: the primitives, the material table and the
+// acceleration structure built over them. HitRecords carry raw Material
+// pointers into this table, so the Scene must outlive every render that uses it.
+//
+// Materials and primitives made through AddMaterial() and Emplace() live in
+// the scene's arena: each type is contiguous in memory, and the whole scene is
+// freed at once. They are handed out as plain pointers, valid while the Scene
+// is. Primitives do not own their materials either, so every material a
+// primitive uses must come from AddMaterial(). add() still takes objects
+// allocated elsewhere.
+class Scene {
+public:
+    Scene() {}
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    // Creates a material in the scene's arena.
+    template <typename T, typename... Args>
+    T* AddMaterial(Args&&... args);
+
+    // Takes shared ownership of a material created elsewhere.
+    const Material* AddMaterial(shared_ptr<Material> material);
+
+    void add(shared_ptr<Hittable> object) { objects.add(object); }
+
+    // Creates a primitive in the scene's arena and adds it to objects, which
+    // refers to it through a shared_ptr that owns nothing.
+    template <typename T, typename... Args>
+    T* Emplace(Args&&... args);
+
+    // Builds the acceleration structure and the light sampler. Call again
+    // after adding or removing objects.
+    void Build(bool use_bvh = true, bool use_sphere_packs = true, const BvhBuildOptions& options = BvhBuildOptions());
+
+    // Updates the acceleration structure after objects moved, keeping its
+    // topology. Sphere packs hold copies of their spheres, so a scene built
+    // with them is rebuilt instead.
+    void Refit();
+
+    // What rays are traced against: the BVH, or the plain object list.
+    const Hittable& Root() const { return use_bvh_ ? static_cast<const Hittable&>(bvh_) : objects; }
+    const Bvh& Accelerator() const { return bvh_; }
+    const LightSampler& Lights() const { return lights_; }
+    const Arena& Storage() const { return arena_; }
+
+private:
+    // Declared first so it is destroyed last, after everything pointing into it.
+    Arena arena_;
+
+public:
+    HittableList objects;
+    std::vector<const Material*> materials;   // every material, in the order added
+    // Whether rays that leave the scene see the sky (Background()) or black,
+    // as in interiors lit only by their lights.
+    bool sky = true;
+
+private:
+    std::vector<shared_ptr<Material>> owned_materials_;   // those added as shared_ptrs
+    Bvh bvh_;
+    LightSampler lights_;
+    bool use_bvh_ = false;
+    bool use_sphere_packs_ = false;
+    BvhBuildOptions build_options_;
+};
+
+template <typename T, typename... Args>
+T* Scene::AddMaterial(Args&&... args) {
+    T* material = arena_.Make<T>(std::forward<Args>(args)...);
+    materials.push_back(material);
+    return material;
+}
+
+template <typename T, typename... Args>
+T* Scene::Emplace(Args&&... args) {
+    T* object = arena_.Make<T>(std::forward<Args>(args)...);
+    objects.add(shared_ptr<Hittable>(shared_ptr<Hittable>(), object));
+    return object;
+}
+
+const Material* Scene::AddMaterial(shared_ptr<Material> material) {
+    owned_materials_.push_back(material);
+    materials.push_back(material.get());
+    return material.get();
+}
+
+void Scene::Build(bool use_bvh, bool use_sphere_packs, const BvhBuildOptions& options) {
+    use_bvh_ = use_bvh;
+    use_sphere_packs_ = use_sphere_packs;
+    build_options_ = options;
+    lights_.Build(objects.objects);
+    if (use_bvh)
+        bvh_.Build(use_sphere_packs ? PackSpheres(objects).objects : objects.objects, options);
+    else
+        bvh_ = Bvh();
+}
+
+void Scene::Refit() {
+    lights_.Build(objects.objects);   // light power follows area
+    if (!use_bvh_)
+        return;
+    if (use_sphere_packs_)
+        Build(use_bvh_, use_sphere_packs_, build_options_);
+    else
+        bvh_.Refit(build_options_.pool);
+}
+
+#endif // !SCENE_H
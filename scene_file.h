@@ -0,0 +1,737 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "utility.h"
+
+#include "mapped_file.h"
+#include "material.h"
+#include "mesh_loader.h"
+#include "scene.h"
+#include "scenes.h"
+#include "sphere.h"
+#include "stopwatch.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Scene files: the view, materials, spheres, triangles and meshes of a Scene,
+// so scenes can be edited and rendered without recompiling. The aspect ratio
+// is not part of a scene; it comes from the image.
+//
+// The text form (.scene) is for authoring. One statement per line, and # starts
+// a comment. Materials are named and must be defined before they are used:
+//
+//   camera lookfrom 13 2 3 lookat 0 0 0 vup 0 1 0 vfov 20 aperture 0.1 focus_dist 10
+//   material ground lambertian 0.5 0.5 0.5     albedo
+//   material gold metal 0.8 0.6 0.2 0.3         albedo, fuzz
+//   material glass dielectric 1.5               index of refraction
+//   material lamp light 4 4 4                   emitted radiance
+//   sphere 0 -1000 0 1000 ground                centre, radius
+//   triangle -3 0.5 -1 -4 -0.3 -1 -2 -0.3 -1 glass
+//   mesh bunny.ply ground                       OBJ or PLY, relative to the scene file
+//   sky off                                     no light from the background
+//
+// Camera keys may come in any order; missing ones keep the defaults of
+// kDefaultView. OBJ usemtl names are looked up among the scene's materials.
+//
+// The binary form (.rtscene) holds the same scene, meshes included, as
+// fixed-size records and flat arrays. It is read in place from a memory
+// mapping: records are decoded straight from the mapped pages and mesh
+// arrays are converted into the meshes in one pass, without parsing.
+
+const View kDefaultView = { Point3(0, 0, 0), Point3(0, 0, -1), Vec3(0, 1, 0), 90, 0.0, 1.0 };
+
+// Where the time of LoadSceneFile() went.
+struct SceneLoadStats {
+    bool binary = false;
+    bool mapped = false;
+    size_t bytes = 0;
+    size_t materials = 0, spheres = 0, triangles = 0, meshes = 0, mesh_faces = 0;
+    double open_ms = 0.0;   // opening or mapping the file
+    double parse_ms = 0.0;  // reading statements or records, including mesh arrays
+    double mesh_ms = 0.0;   // loading referenced mesh files, building or refitting mesh BVHs
+    std::vector<std::string> files; // the scene file and every mesh file it named
+};
+
+bool IsSceneFile(const std::string& name);
+bool LoadSceneFile(const std::string& path, Scene& world, View& view, SceneLoadStats& stats, bool use_mapping = true);
+
+// Writes world and view as text or binary, by the extension of path. Only
+// the binary form can hold meshes, which have no file of their own.
+bool SaveSceneFile(const std::string& path, const Scene& world, const View& view);
+
+// A canonical scene by name (scenes.h), or a scene file.
+bool BuildScene(const std::string& name, Scene& world, View& view, const std::vector<std::string>& mesh_paths,
+    SceneLoadStats* stats = nullptr, bool use_mapping = true);
+
+void ReportSceneLoad(std::ostream& out, const std::string& path, const SceneLoadStats& stats);
+
+// Binary layout, native byte order, every array at an 8-byte aligned offset
+// from the start of the file:
+//
+//   SceneFileHeader
+//   SceneMaterialRecord[material_count]  at material_offset
+//   SceneSphereRecord[sphere_count]      at sphere_offset
+//   SceneTriangleRecord[triangle_count]  at triangle_offset
+//   SceneMeshRecord[mesh_count]          at mesh_offset, each pointing at its
+//                                        own vertex, index, material and BVH arrays
+//
+// Materials are referenced by index. Mesh vertices are stored as float, which
+// is the precision mesh files come in; everything else is double. Faces are
+// stored in the leaf order of their BVH, whose nodes are saved without boxes:
+// refitting them on load costs a fraction of a build.
+struct SceneFileHeader {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t material_count;
+    uint32_t sphere_count;
+    uint32_t triangle_count;
+    uint32_t mesh_count;
+    uint32_t flags;     // kSceneFileNoSky
+    double camera[12];  // lookfrom, lookat, vup, vfov, aperture, focus_dist
+    uint64_t material_offset, sphere_offset, triangle_offset, mesh_offset;
+};
+
+struct SceneMaterialRecord {
+    uint32_t type;      // MaterialType
+    uint32_t reserved;
+    double values[4];   // albedo and fuzz, the index of refraction, or emitted radiance
+};
+
+struct SceneSphereRecord {
+    double center[3];
+    double radius;
+    uint32_t material;
+    uint32_t reserved;
+};
+
+struct SceneTriangleRecord {
+    double vertices[9];
+    uint32_t material;
+    uint32_t reserved;
+};
+
+struct SceneMeshRecord {
+    uint64_t vertex_count, face_count, range_count;
+    uint64_t positions_offset;  // float[3 * vertex_count]
+    uint64_t normals_offset;    // float[3 * vertex_count], or 0 for none
+    uint64_t uvs_offset;        // float[2 * vertex_count], or 0 for none
+    uint64_t indices_offset;    // uint32[3 * face_count]
+    uint64_t ranges_offset;     // SceneMaterialRange[range_count]
+    uint64_t node_count;
+    uint64_t nodes_offset;      // SceneBvhNode[node_count] of the face BVH, or 0 to build one
+};
+
+struct SceneMaterialRange {
+    uint32_t first_face;
+    uint32_t material;
+};
+
+// Topology of a BvhNode; the boxes are refitted on load.
+struct SceneBvhNode {
+    int32_t offset, count, axis;
+};
+
+const char kSceneFileMagic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '1' };
+const uint32_t kSceneFileNoSky = 1;
+
+inline bool HasSuffix(const std::string& text, const char* suffix) {
+    size_t n = strlen(suffix);
+    return text.size() >= n && text.compare(text.size() - n, n, suffix) == 0;
+}
+
+bool IsSceneFile(const std::string& name) {
+    return HasSuffix(name, ".scene") || HasSuffix(name, ".rtscene");
+}
+
+// Text form
+
+// Reads a number with correct rounding, so a saved scene reads back bit for
+// bit; TextCursor::ParseDouble trades that for speed on mesh files.
+inline bool ParseSceneNumber(TextCursor& in, double& out) {
+    in.SkipSpaces();
+    const char* p = in.p;
+    if (p < in.end && *p == '+')
+        ++p;
+    auto result = std::from_chars(p, in.end, out);
+    if (result.ec != std::errc())
+        return false;
+    in.p = result.ptr;
+    return true;
+}
+
+// Mesh paths in a scene file are relative to the file's directory.
+inline std::string ResolveScenePath(const std::string& scene_path, const std::string& path) {
+    if (path.empty() || path[0] == '/' || path[0] == '\\' || path.find(':') != std::string::npos)
+        return path;
+    auto slash = scene_path.find_last_of("/\\");
+    return slash == std::string::npos ? path : scene_path.substr(0, slash + 1) + path;
+}
+
+// Reads the rest of a camera statement into view; keys left out keep their
+// values. Shared with batch files (batch.h).
+bool ParseViewKeys(TextCursor& in, View& view, std::string& error) {
+    double v[3];
+    while (!in.AtLineEnd()) {
+        std::string key = in.ParseWord();
+        if (key == "lookfrom" || key == "lookat" || key == "vup") {
+            for (int k = 0; k < 3; k++) {
+                if (!ParseSceneNumber(in, v[k])) {
+                    error = "malformed camera " + key;
+                    return false;
+                }
+            }
+            (key == "lookfrom" ? view.lookfrom : key == "lookat" ? view.lookat : view.vup) = Vec3(v[0], v[1], v[2]);
+        } else if (key == "vfov" || key == "aperture" || key == "focus_dist") {
+            if (!ParseSceneNumber(in, v[0])) {
+                error = "malformed camera " + key;
+                return false;
+            }
+            (key == "vfov" ? view.vfov : key == "aperture" ? view.aperture : view.focus_dist) = v[0];
+        } else {
+            error = "unknown camera parameter " + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseTextScene(const std::string& path, const MappedFile& file, Scene& world, View& view, SceneLoadStats& stats, bool use_mapping) {
+    MaterialMap materials;
+    TextCursor in{ file.Data(), file.Data() + file.Size() };
+    size_t line = 0;
+
+    auto fail = [&](const std::string& message) {
+        std::cerr << path << ":" << line << ": " << message << "\n";
+        return false;
+    };
+    auto numbers = [&](double* values, int count) {
+        for (int k = 0; k < count; k++)
+            if (!ParseSceneNumber(in, values[k]))
+                return false;
+        return true;
+    };
+
+    view = kDefaultView;
+    while (in.p < in.end) {
+        line++;
+        if (in.AtLineEnd()) {
+            in.SkipLine();
+            continue;
+        }
+
+        std::string keyword = in.ParseWord();
+        double v[9];
+        if (keyword == "camera") {
+            std::string error;
+            if (!ParseViewKeys(in, view, error))
+                return fail(error);
+        } else if (keyword == "material") {
+            std::string name = in.ParseWord();
+            std::string type = in.ParseWord();
+            const Material* material;
+            if (type == "lambertian" && numbers(v, 3))
+                material = world.AddMaterial<Lambertian>(Color(v[0], v[1], v[2]));
+            else if (type == "metal" && numbers(v, 4))
+                material = world.AddMaterial<Metal>(Color(v[0], v[1], v[2]), Real(v[3]));
+            else if (type == "dielectric" && numbers(v, 1))
+                material = world.AddMaterial<Dielectric>(Real(v[0]));
+            else if (type == "light" && numbers(v, 3))
+                material = world.AddMaterial<DiffuseLight>(Color(v[0], v[1], v[2]));
+            else
+                return fail("malformed material " + name);
+            if (!materials.emplace(name, material).second)
+                return fail("material " + name + " defined twice");
+            stats.materials++;
+        } else if (keyword == "sky") {
+            std::string value = in.ParseWord();
+            if (value != "on" && value != "off")
+                return fail("sky must be on or off");
+            world.sky = value == "on";
+        } else if (keyword == "sphere" || keyword == "triangle" || keyword == "mesh") {
+            std::string mesh_path;
+            bool triangle = keyword == "triangle";
+            if (keyword == "mesh")
+                mesh_path = in.ParseWord();
+            else if (!numbers(v, triangle ? 9 : 4))
+                return fail("malformed " + keyword);
+
+            std::string name = in.ParseWord();
+            auto it = materials.find(name);
+            if (it == materials.end())
+                return fail("unknown material " + name);
+
+            if (keyword == "sphere") {
+                world.Emplace<Sphere>(Point3(v[0], v[1], v[2]), Real(v[3]), it->second);
+                stats.spheres++;
+            } else if (triangle) {
+                world.Emplace<Triangle>(Point3(v[0], v[1], v[2]), Point3(v[3], v[4], v[5]), Point3(v[6], v[7], v[8]), it->second);
+                stats.triangles++;
+            } else {
+                StopWatch stop_watch;
+                stop_watch.Begin();
+                stats.files.push_back(ResolveScenePath(path, mesh_path));
+                auto mesh = LoadMesh(stats.files.back(), it->second, materials, use_mapping);
+                if (!mesh)
+                    return fail("cannot load mesh " + mesh_path);
+                world.add(mesh);
+                stats.mesh_ms += stop_watch.ElapsedNanoseconds() * 1e-6;
+                stats.meshes++;
+                stats.mesh_faces += mesh->FaceCount();
+            }
+        } else {
+            return fail("unknown statement " + keyword);
+        }
+
+        if (!in.AtLineEnd())
+            return fail("unexpected text after " + keyword);
+        in.SkipLine();
+    }
+    return true;
+}
+
+// Shortest text that reads back as the same double.
+inline void WriteSceneNumber(std::ostream& out, double value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.write(buffer, result.ptr - buffer);
+}
+
+inline void WriteSceneVector(std::ostream& out, const Vec3& v) {
+    for (int k = 0; k < 3; k++) {
+        out << ' ';
+        WriteSceneNumber(out, v[k]);
+    }
+}
+
+// Binary form
+
+// count records of T at offset, or nullptr if they run past the end of the file.
+template <typename T>
+const T* SceneFileArray(const MappedFile& file, uint64_t offset, uint64_t count) {
+    if (offset % alignof(T) != 0 || offset > file.Size() || count > (file.Size() - offset) / sizeof(T))
+        return nullptr;
+    return reinterpret_cast<const T*>(file.Data() + offset);
+}
+
+bool ReadBinaryScene(const std::string& path, const MappedFile& file, Scene& world, View& view, SceneLoadStats& stats) {
+    const SceneFileHeader* header = SceneFileArray<SceneFileHeader>(file, 0, 1);
+    if (!header || std::memcmp(header->magic, kSceneFileMagic, sizeof(header->magic)) != 0) {
+        std::cerr << path << ": not a binary scene file\n";
+        return false;
+    }
+    if (header->byte_order != 0x01020304) {
+        std::cerr << path << ": scene file of a different byte order\n";
+        return false;
+    }
+
+    const SceneMaterialRecord* material_records = SceneFileArray<SceneMaterialRecord>(file, header->material_offset, header->material_count);
+    const SceneSphereRecord* spheres = SceneFileArray<SceneSphereRecord>(file, header->sphere_offset, header->sphere_count);
+    const SceneTriangleRecord* triangles = SceneFileArray<SceneTriangleRecord>(file, header->triangle_offset, header->triangle_count);
+    const SceneMeshRecord* meshes = SceneFileArray<SceneMeshRecord>(file, header->mesh_offset, header->mesh_count);
+    if (!material_records || !spheres || !triangles || !meshes) {
+        std::cerr << path << ": truncated scene file\n";
+        return false;
+    }
+
+    world.sky = !(header->flags & kSceneFileNoSky);
+    const double* c = header->camera;
+    view = View{ Point3(c[0], c[1], c[2]), Point3(c[3], c[4], c[5]), Vec3(c[6], c[7], c[8]), c[9], c[10], c[11] };
+
+    std::vector<const Material*> materials;
+    for (uint32_t i = 0; i < header->material_count; i++) {
+        const SceneMaterialRecord& m = material_records[i];
+        Color albedo(m.values[0], m.values[1], m.values[2]);
+        switch (static_cast<MaterialType>(m.type)) {
+        case MaterialType::LAMBERTIAN: materials.push_back(world.AddMaterial<Lambertian>(albedo)); break;
+        case MaterialType::METAL: materials.push_back(world.AddMaterial<Metal>(albedo, Real(m.values[3]))); break;
+        case MaterialType::DIELECTRIC: materials.push_back(world.AddMaterial<Dielectric>(Real(m.values[0]))); break;
+        case MaterialType::EMISSIVE: materials.push_back(world.AddMaterial<DiffuseLight>(albedo)); break;
+        default:
+            std::cerr << path << ": unknown material type " << m.type << "\n";
+            return false;
+        }
+    }
+    auto bad_material = [&](uint32_t index) {
+        if (index < materials.size())
+            return false;
+        std::cerr << path << ": material index " << index << " out of range\n";
+        return true;
+    };
+
+    for (uint32_t i = 0; i < header->sphere_count; i++) {
+        const SceneSphereRecord& s = spheres[i];
+        if (bad_material(s.material))
+            return false;
+        world.Emplace<Sphere>(Point3(s.center[0], s.center[1], s.center[2]), Real(s.radius), materials[s.material]);
+    }
+    for (uint32_t i = 0; i < header->triangle_count; i++) {
+        const double* v = triangles[i].vertices;
+        if (bad_material(triangles[i].material))
+            return false;
+        world.Emplace<Triangle>(Point3(v[0], v[1], v[2]), Point3(v[3], v[4], v[5]), Point3(v[6], v[7], v[8]), materials[triangles[i].material]);
+    }
+
+    for (uint32_t i = 0; i < header->mesh_count; i++) {
+        const SceneMeshRecord& record = meshes[i];
+        if (record.vertex_count > file.Size() || record.face_count > file.Size()) {
+            std::cerr << path << ": corrupt mesh " << i << "\n";
+            return false;
+        }
+        const float* positions = SceneFileArray<float>(file, record.positions_offset, 3 * record.vertex_count);
+        const float* normals = record.normals_offset ? SceneFileArray<float>(file, record.normals_offset, 3 * record.vertex_count) : nullptr;
+        const float* uvs = record.uvs_offset ? SceneFileArray<float>(file, record.uvs_offset, 2 * record.vertex_count) : nullptr;
+        const uint32_t* indices = SceneFileArray<uint32_t>(file, record.indices_offset, 3 * record.face_count);
+        const SceneMaterialRange* ranges = SceneFileArray<SceneMaterialRange>(file, record.ranges_offset, record.range_count);
+        const SceneBvhNode* nodes = record.nodes_offset ? SceneFileArray<SceneBvhNode>(file, record.nodes_offset, record.node_count) : nullptr;
+        if (!positions || (record.normals_offset && !normals) || (record.uvs_offset && !uvs) || !indices || !ranges || record.range_count == 0
+            || (record.nodes_offset && !nodes)) {
+            std::cerr << path << ": truncated mesh " << i << "\n";
+            return false;
+        }
+
+        auto mesh = make_shared<TriangleMesh>();
+        size_t vertex_count = static_cast<size_t>(record.vertex_count);
+        mesh->positions.resize(vertex_count);
+        for (size_t k = 0; k < vertex_count; k++)
+            mesh->positions[k] = Point3(positions[3 * k], positions[3 * k + 1], positions[3 * k + 2]);
+        if (normals) {
+            mesh->normals.resize(vertex_count);
+            for (size_t k = 0; k < vertex_count; k++)
+                mesh->normals[k] = Vec3(normals[3 * k], normals[3 * k + 1], normals[3 * k + 2]);
+        }
+        if (uvs) {
+            mesh->uvs.resize(vertex_count);
+            for (size_t k = 0; k < vertex_count; k++)
+                mesh->uvs[k] = TexCoord{ uvs[2 * k], uvs[2 * k + 1] };
+        }
+        mesh->indices.assign(indices, indices + 3 * record.face_count);
+        for (uint32_t index : mesh->indices) {
+            if (index >= vertex_count) {
+                std::cerr << path << ": face index out of range in mesh " << i << "\n";
+                return false;
+            }
+        }
+        for (uint64_t k = 0; k < record.range_count; k++) {
+            if (bad_material(ranges[k].material))
+                return false;
+            if (k == 0)
+                mesh->SetMaterial(materials[ranges[k].material]);
+            else
+                mesh->AddMaterialRange(ranges[k].first_face, materials[ranges[k].material]);
+        }
+
+        StopWatch stop_watch;
+        stop_watch.Begin();
+        if (nodes) {
+            std::vector<BvhNode> tree(static_cast<size_t>(record.node_count));
+            for (size_t k = 0; k < tree.size(); k++)
+                tree[k] = BvhNode{ Aabb(), nodes[k].offset, nodes[k].count, nodes[k].axis };
+            if (!mesh->Build(std::move(tree))) {
+                std::cerr << path << ": invalid BVH or more than " << TriangleMesh::kMaxMaterials << " materials in mesh " << i << "\n";
+                return false;
+            }
+        } else if (!mesh->Build()) {
+            std::cerr << path << ": more than " << TriangleMesh::kMaxMaterials << " materials in mesh " << i << "\n";
+            return false;
+        }
+        stats.mesh_ms += stop_watch.ElapsedNanoseconds() * 1e-6;
+        stats.mesh_faces += mesh->FaceCount();
+        world.add(mesh);
+    }
+
+    stats.materials = header->material_count;
+    stats.spheres = header->sphere_count;
+    stats.triangles = header->triangle_count;
+    stats.meshes = header->mesh_count;
+    return true;
+}
+
+// Appends bytes at the next 8-byte boundary and returns their offset.
+inline uint64_t AppendSceneBytes(std::string& blob, const void* data, size_t size) {
+    blob.resize((blob.size() + 7) & ~size_t(7), '\0');
+    uint64_t offset = blob.size();
+    blob.append(static_cast<const char*>(data), size);
+    return offset;
+}
+
+template <typename T>
+uint64_t AppendSceneArray(std::string& blob, const std::vector<T>& values) {
+    return AppendSceneBytes(blob, values.data(), values.size() * sizeof(T));
+}
+
+// Loading and saving
+
+bool LoadSceneFile(const std::string& path, Scene& world, View& view, SceneLoadStats& stats, bool use_mapping) {
+    stats = SceneLoadStats();
+    stats.files.push_back(path);
+    StopWatch stop_watch;
+    stop_watch.Begin();
+    MappedFile file;
+    if (!file.Open(path, use_mapping)) {
+        std::cerr << path << ": cannot open file\n";
+        return false;
+    }
+    stats.open_ms = stop_watch.ElapsedNanoseconds() * 1e-6;
+    stats.binary = HasSuffix(path, ".rtscene");
+    stats.mapped = file.IsMapped();
+    stats.bytes = file.Size();
+
+    stop_watch.Begin();
+    bool ok = stats.binary ? ReadBinaryScene(path, file, world, view, stats) : ParseTextScene(path, file, world, view, stats, use_mapping);
+    stats.parse_ms = stop_watch.ElapsedNanoseconds() * 1e-6 - stats.mesh_ms;
+    return ok;
+}
+
+bool SaveSceneFile(const std::string& path, const Scene& world, const View& view) {
+    bool binary = HasSuffix(path, ".rtscene");
+    if (!binary && !HasSuffix(path, ".scene")) {
+        std::cerr << path << ": scene files end in .scene or .rtscene\n";
+        return false;
+    }
+
+    // Number the materials in table order; materials the table does not own
+    // are appended as they are found.
+    std::vector<const Material*> materials;
+    std::unordered_map<const Material*, uint32_t> material_index;
+    auto index_of = [&](const Material* m) {
+        auto it = material_index.find(m);
+        if (it != material_index.end())
+            return it->second;
+        materials.push_back(m);
+        return material_index[m] = static_cast<uint32_t>(materials.size() - 1);
+    };
+    for (const Material* m : world.materials)
+        index_of(m);
+
+    std::vector<const Sphere*> spheres;
+    std::vector<const Triangle*> triangles;
+    std::vector<const TriangleMesh*> meshes;
+    for (const auto& object : world.objects.objects) {
+        if (auto sphere = dynamic_cast<const Sphere*>(object.get())) {
+            spheres.push_back(sphere);
+            index_of(sphere->mat_ptr_);
+        } else if (auto triangle = dynamic_cast<const Triangle*>(object.get())) {
+            triangles.push_back(triangle);
+            index_of(triangle->mat_ptr_);
+        } else if (auto mesh = dynamic_cast<const TriangleMesh*>(object.get())) {
+            meshes.push_back(mesh);
+            for (size_t f = 0; f < std::max<size_t>(1, mesh->FaceCount()); f++)
+                index_of(mesh->FaceMaterial(f));
+        } else {
+            std::cerr << path << ": the scene has an object scene files cannot describe\n";
+            return false;
+        }
+    }
+    for (const Material* m : materials) {
+        if (!m || m->type_ == MaterialType::OTHER) {
+            std::cerr << path << ": the scene has a material scene files cannot describe\n";
+            return false;
+        }
+    }
+    if (!binary && !meshes.empty()) {
+        std::cerr << path << ": meshes can only be saved in the binary form (.rtscene)\n";
+        return false;
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << path << ": cannot open for writing\n";
+        return false;
+    }
+
+    if (!binary) {
+        out << "camera lookfrom";
+        WriteSceneVector(out, view.lookfrom);
+        out << " lookat";
+        WriteSceneVector(out, view.lookat);
+        out << " vup";
+        WriteSceneVector(out, view.vup);
+        out << " vfov ";
+        WriteSceneNumber(out, view.vfov);
+        out << " aperture ";
+        WriteSceneNumber(out, view.aperture);
+        out << " focus_dist ";
+        WriteSceneNumber(out, view.focus_dist);
+        out << "\n";
+        if (!world.sky)
+            out << "sky off\n";
+        out << "\n";
+
+        for (size_t i = 0; i < materials.size(); i++) {
+            out << "material m" << i;
+            if (auto lambertian = dynamic_cast<const Lambertian*>(materials[i])) {
+                out << " lambertian";
+                WriteSceneVector(out, lambertian->albedo);
+            } else if (auto metal = dynamic_cast<const Metal*>(materials[i])) {
+                out << " metal";
+                WriteSceneVector(out, metal->albedo);
+                out << ' ';
+                WriteSceneNumber(out, metal->fuzz);
+            } else if (auto dielectric = dynamic_cast<const Dielectric*>(materials[i])) {
+                out << " dielectric ";
+                WriteSceneNumber(out, dielectric->ir);
+            } else if (auto light = dynamic_cast<const DiffuseLight*>(materials[i])) {
+                out << " light";
+                WriteSceneVector(out, light->emit);
+            }
+            out << "\n";
+        }
+        out << "\n";
+
+        for (const Sphere* sphere : spheres) {
+            out << "sphere";
+            WriteSceneVector(out, sphere->center_);
+            out << ' ';
+            WriteSceneNumber(out, sphere->radius_);
+            out << " m" << material_index[sphere->mat_ptr_] << "\n";
+        }
+        for (const Triangle* triangle : triangles) {
+            out << "triangle";
+            WriteSceneVector(out, triangle->a_);
+            WriteSceneVector(out, triangle->b_);
+            WriteSceneVector(out, triangle->c_);
+            out << " m" << material_index[triangle->mat_ptr_] << "\n";
+        }
+    } else {
+        std::string blob(sizeof(SceneFileHeader), '\0');
+        SceneFileHeader header{};
+        std::memcpy(header.magic, kSceneFileMagic, sizeof(header.magic));
+        header.byte_order = 0x01020304;
+        header.material_count = static_cast<uint32_t>(materials.size());
+        header.sphere_count = static_cast<uint32_t>(spheres.size());
+        header.triangle_count = static_cast<uint32_t>(triangles.size());
+        header.mesh_count = static_cast<uint32_t>(meshes.size());
+        header.flags = world.sky ? 0 : kSceneFileNoSky;
+        const Vec3* camera_vectors[3] = { &view.lookfrom, &view.lookat, &view.vup };
+        for (int i = 0; i < 3; i++)
+            for (int k = 0; k < 3; k++)
+                header.camera[3 * i + k] = (*camera_vectors[i])[k];
+        header.camera[9] = view.vfov;
+        header.camera[10] = view.aperture;
+        header.camera[11] = view.focus_dist;
+
+        std::vector<SceneMaterialRecord> material_records(materials.size());
+        for (size_t i = 0; i < materials.size(); i++) {
+            SceneMaterialRecord& record = material_records[i];
+            record.type = static_cast<uint32_t>(materials[i]->type_);
+            if (auto lambertian = dynamic_cast<const Lambertian*>(materials[i])) {
+                for (int k = 0; k < 3; k++)
+                    record.values[k] = lambertian->albedo[k];
+            } else if (auto metal = dynamic_cast<const Metal*>(materials[i])) {
+                for (int k = 0; k < 3; k++)
+                    record.values[k] = metal->albedo[k];
+                record.values[3] = metal->fuzz;
+            } else if (auto dielectric = dynamic_cast<const Dielectric*>(materials[i])) {
+                record.values[0] = dielectric->ir;
+            } else if (auto light = dynamic_cast<const DiffuseLight*>(materials[i])) {
+                for (int k = 0; k < 3; k++)
+                    record.values[k] = light->emit[k];
+            }
+        }
+        header.material_offset = AppendSceneArray(blob, material_records);
+
+        std::vector<SceneSphereRecord> sphere_records(spheres.size());
+        for (size_t i = 0; i < spheres.size(); i++) {
+            for (int k = 0; k < 3; k++)
+                sphere_records[i].center[k] = spheres[i]->center_[k];
+            sphere_records[i].radius = spheres[i]->radius_;
+            sphere_records[i].material = material_index[spheres[i]->mat_ptr_];
+        }
+        header.sphere_offset = AppendSceneArray(blob, sphere_records);
+
+        std::vector<SceneTriangleRecord> triangle_records(triangles.size());
+        for (size_t i = 0; i < triangles.size(); i++) {
+            const Point3* vertices[3] = { &triangles[i]->a_, &triangles[i]->b_, &triangles[i]->c_ };
+            for (int v = 0; v < 3; v++)
+                for (int k = 0; k < 3; k++)
+                    triangle_records[i].vertices[3 * v + k] = (*vertices[v])[k];
+            triangle_records[i].material = material_index[triangles[i]->mat_ptr_];
+        }
+        header.triangle_offset = AppendSceneArray(blob, triangle_records);
+
+        std::vector<SceneMeshRecord> mesh_records(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const TriangleMesh& mesh = *meshes[i];
+            SceneMeshRecord& record = mesh_records[i];
+            record.vertex_count = mesh.VertexCount();
+            record.face_count = mesh.FaceCount();
+
+            std::vector<float> values;
+            for (const Point3& p : mesh.positions)
+                values.insert(values.end(), { float(p.x()), float(p.y()), float(p.z()) });
+            record.positions_offset = AppendSceneArray(blob, values);
+            if (!mesh.normals.empty()) {
+                values.clear();
+                for (const Vec3& n : mesh.normals)
+                    values.insert(values.end(), { float(n.x()), float(n.y()), float(n.z()) });
+                record.normals_offset = AppendSceneArray(blob, values);
+            }
+            if (!mesh.uvs.empty()) {
+                values.clear();
+                for (const TexCoord& uv : mesh.uvs)
+                    values.insert(values.end(), { float(uv.u), float(uv.v) });
+                record.uvs_offset = AppendSceneArray(blob, values);
+            }
+            record.indices_offset = AppendSceneArray(blob, mesh.indices);
+
+            // Runs of faces with the same material, in the mesh's current face order.
+            std::vector<SceneMaterialRange> ranges;
+            for (size_t f = 0; f < mesh.FaceCount(); f++) {
+                uint32_t material = material_index[mesh.FaceMaterial(f)];
+                if (ranges.empty() || ranges.back().material != material)
+                    ranges.push_back(SceneMaterialRange{ static_cast<uint32_t>(f), material });
+            }
+            if (ranges.empty())
+                ranges.push_back(SceneMaterialRange{ 0, material_index[mesh.FaceMaterial(0)] });
+            record.range_count = ranges.size();
+            record.ranges_offset = AppendSceneArray(blob, ranges);
+
+            std::vector<SceneBvhNode> nodes;
+            for (const BvhNode& node : mesh.Tree().nodes)
+                nodes.push_back(SceneBvhNode{ node.offset, node.count, node.axis });
+            record.node_count = nodes.size();
+            if (!nodes.empty())
+                record.nodes_offset = AppendSceneArray(blob, nodes);
+        }
+        header.mesh_offset = AppendSceneArray(blob, mesh_records);
+
+        std::memcpy(&blob[0], &header, sizeof(header));
+        out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+    }
+
+    if (!out) {
+        std::cerr << path << ": write failed\n";
+        return false;
+    }
+    return true;
+}
+
+bool BuildScene(const std::string& name, Scene& world, View& view, const std::vector<std::string>& mesh_paths, SceneLoadStats* stats, bool use_mapping) {
+    if (!IsSceneFile(name))
+        return BuildCanonicalScene(name, world, view, mesh_paths);
+    SceneLoadStats local_stats;
+    return LoadSceneFile(name, world, view, stats ? *stats : local_stats, use_mapping);
+}
+
+void ReportSceneLoad(std::ostream& out, const std::string& path, const SceneLoadStats& stats) {
+    out << "Scene " << path << " (" << (stats.binary ? "binary" : "text") << ", " << stats.bytes << " bytes, "
+        << (stats.mapped ? "mapped" : "read") << "): " << stats.materials << " materials, " << stats.spheres << " spheres, "
+        << stats.triangles << " triangles, " << stats.meshes << " meshes with " << stats.mesh_faces << " faces\n";
+    out << std::fixed << std::setprecision(2) << "  loaded in " << stats.open_ms + stats.parse_ms + stats.mesh_ms << " ms: open "
+        << stats.open_ms << " ms, parse " << stats.parse_ms << " ms, meshes " << stats.mesh_ms << " ms\n";
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
+
+#endif // !SCENE_FILE_H
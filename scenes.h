@@ -0,0 +1,329 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "utility.h"
+
+#include "bvh.h"
+#include "camera.h"
+#include "instance.h"
+#include "material.h"
+#include "mesh_loader.h"
+#include "scene.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The canonical scenes used by main() and the benchmark. Each one fills a
+// Scene and sets the View it is meant to be seen from. Scenes that draw
+// random numbers expect the generator to be seeded first.
+
+// Camera placement of a scene; the aspect ratio comes from the image.
+struct View {
+    Point3 lookfrom;
+    Point3 lookat;
+    Vec3 vup;
+    double vfov;
+    double aperture;
+    double focus_dist;
+};
+
+Camera MakeCamera(const View& view, double aspect_ratio) {
+    return Camera(view.lookfrom, view.lookat, view.vup, view.vfov, aspect_ratio, view.aperture, view.focus_dist);
+}
+
+// Glass and metal spheres next to a triangle; the scene main() renders by default.
+void DefaultScene(Scene& world, View& view) {
+    auto material_ground = world.AddMaterial<Lambertian>(Color(0.8, 0.8, 0.0));
+    auto material_center = world.AddMaterial<Dielectric>(1.5);
+    auto material_left = world.AddMaterial<Dielectric>(1.5);
+    auto material_right = world.AddMaterial<Metal>(Color(0.8, 0.6, 0.2), 1.0);
+
+    world.Emplace<Sphere>(Point3(0.0, -100.5, -1.0), 100.0, material_ground);
+    world.Emplace<Sphere>(Point3(0.0, 0.0, -1.0), 0.5, material_center);
+    world.Emplace<Sphere>(Point3(-1.0, 0.0, -1.0), 0.5, material_left);
+    world.Emplace<Triangle>(Point3(-3.0, 0.5, -1.0), Point3(-4.0, -0.3, -1.0), Point3(-2.0, -0.3, -1.0), material_left);
+    world.Emplace<Sphere>(Point3(-1.0, 0.0, -1.0), -0.4, material_left);
+    world.Emplace<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, material_right);
+
+    //Point3 lookfrom(6, 1, 2);
+    view = View{ Point3(4, 1, 10), Point3(0, 0, 0), Vec3(0, 1, 0), 20, 0.1, 10.0 };
+}
+
+void GenerateWorldWithTriangles(Scene& world, View& view) {
+    auto material_ground = world.AddMaterial<Lambertian>(Color(0.8, 0.8, 0.0));
+    auto material_center = world.AddMaterial<Lambertian>(Color(0.7, 0.3, 0.3));
+    auto material_left = world.AddMaterial<Metal>(Color(0.8,0.8,0.8), 0.3);
+    auto material_right = world.AddMaterial<Metal>(Color(0.8,0.6,0.2), 1.0);
+
+    world.Emplace<Sphere>(Point3(0.0, -100.5, -1.0), 100.0, material_ground);
+    world.Emplace<Sphere>(Point3(0.0, 0.0, -1.0), 0.5, material_center);
+    world.Emplace<Triangle>(Point3(-1.0, 0.4, -1), Point3(-1.8, -0.3, -1), Point3(-0.8, -0.3, -1), material_left);
+    world.Emplace<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, material_right);
+
+    view = View{ Point3(0, 0, 1), Point3(0, 0, -1), Vec3(0, 1, 0), 90, 0.0, 2.0 };
+}
+
+void RandomScene(Scene& world, View& view) {
+    auto ground_material = world.AddMaterial<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.Emplace<Sphere>(Point3(0, -1000, 0), 1000, ground_material);
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = RandomDouble();
+            Point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
+
+            if ((center - Point3(4, 0.2, 0)).Length() > 0.9) {
+                const Material* sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = Color::Random() * Color::Random();
+                    sphere_material = world.AddMaterial<Lambertian>(albedo);
+                    world.Emplace<Sphere>(center, 0.2, sphere_material);
+                }
+                else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = Color::Random(0.5, 1);
+                    auto fuzz = RandomDouble(0, 0.5);
+                    sphere_material = world.AddMaterial<Metal>(albedo, fuzz);
+                    world.Emplace<Sphere>(center, 0.2, sphere_material);
+                }
+                else {
+                    // glass
+                    sphere_material = world.AddMaterial<Dielectric>(1.5);
+                    world.Emplace<Sphere>(center, 0.2, sphere_material);
+                }
+            }
+        }
+    }
+
+    auto material1 = world.AddMaterial<Dielectric>(1.5);
+    world.Emplace<Sphere>(Point3(0, 1, 0), 1.0, material1);
+
+    auto material2 = world.AddMaterial<Lambertian>(Color(0.4, 0.2, 0.1));
+    world.Emplace<Sphere>(Point3(-4, 1, 0), 1.0, material2);
+
+    auto material3 = world.AddMaterial<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    world.Emplace<Sphere>(Point3(4, 1, 0), 1.0, material3);
+
+    view = View{ Point3(13, 2, 3), Point3(0, 0, 0), Vec3(0, 1, 0), 20, 0.1, 10.0 };
+}
+
+// UV sphere as an indexed mesh with per-vertex normals and texture coordinates.
+shared_ptr<TriangleMesh> TessellatedSphere(const Point3& center, double radius, int stacks, int slices, const Material* m) {
+    auto mesh = make_shared<TriangleMesh>();
+    for (int i = 0; i <= stacks; i++) {
+        double theta = pi * i / stacks;
+        for (int j = 0; j <= slices; j++) {
+            double phi = 2 * pi * j / slices;
+            Vec3 n(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+            mesh->positions.push_back(center + Real(radius) * n);
+            mesh->normals.push_back(n);
+            mesh->uvs.push_back(TexCoord{ Real(double(j) / slices), Real(1 - double(i) / stacks) });
+        }
+    }
+
+    uint32_t row = static_cast<uint32_t>(slices + 1);
+    for (uint32_t i = 0; i < static_cast<uint32_t>(stacks); i++) {
+        for (uint32_t j = 0; j < static_cast<uint32_t>(slices); j++) {
+            uint32_t a = i * row + j, b = a + 1, c = a + row, d = c + 1;
+            // The pole rows collapse to a point; skip their degenerate halves.
+            if (i != 0)
+                mesh->indices.insert(mesh->indices.end(), { a, b, c });
+            if (i + 1 != static_cast<uint32_t>(stacks))
+                mesh->indices.insert(mesh->indices.end(), { b, d, c });
+        }
+    }
+
+    mesh->SetMaterial(m);
+    mesh->Build();
+    return mesh;
+}
+
+// Large triangle meshes on a ground plane: the given mesh files, or about
+// 780k triangles of tessellated spheres when there are none.
+bool LargeMeshScene(Scene& world, View& view, const std::vector<std::string>& mesh_paths) {
+    auto material_ground = world.AddMaterial<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.Emplace<Sphere>(Point3(0, -1000, 0), 1000, material_ground);
+
+    auto material_mesh = world.AddMaterial<Lambertian>(Color(0.5, 0.5, 0.5));
+    for (const auto& path : mesh_paths) {
+        auto mesh = LoadMesh(path, material_mesh);
+        if (!mesh)
+            return false;
+        world.add(mesh);
+    }
+
+    if (mesh_paths.empty()) {
+        world.add(TessellatedSphere(Point3(-4, 1, 0), 1.0, 256, 512, world.AddMaterial<Lambertian>(Color(0.4, 0.2, 0.1))));
+        world.add(TessellatedSphere(Point3(0, 1, 0), 1.0, 256, 512, world.AddMaterial<Dielectric>(1.5)));
+        world.add(TessellatedSphere(Point3(4, 1, 0), 1.0, 256, 512, world.AddMaterial<Metal>(Color(0.7, 0.6, 0.5), 0.0)));
+    }
+
+    view = View{ Point3(13, 2, 3), Point3(0, 0, 0), Vec3(0, 1, 0), 20, 0.1, 10.0 };
+    return true;
+}
+
+// Low-poly tree standing on the origin, about 1.3 units tall: a trunk and
+// three stacked cones of foliage, with segments faces around each.
+shared_ptr<TriangleMesh> TreeMesh(const Material* trunk, const Material* leaves, int segments) {
+    auto mesh = make_shared<TriangleMesh>();
+    // Adds a frustum from radius r0 at height y0 to r1 at y1; r1 = 0 makes a cone.
+    auto add_frustum = [&](double r0, double y0, double r1, double y1) {
+        uint32_t base = static_cast<uint32_t>(mesh->positions.size());
+        for (int j = 0; j <= segments; j++) {
+            double phi = 2 * pi * j / segments;
+            mesh->positions.push_back(Point3(r0 * cos(phi), y0, r0 * sin(phi)));
+            mesh->positions.push_back(Point3(r1 * cos(phi), y1, r1 * sin(phi)));
+        }
+        for (uint32_t j = 0; j < static_cast<uint32_t>(segments); j++) {
+            uint32_t a = base + 2 * j, b = a + 1, c = a + 2, d = a + 3;
+            mesh->indices.insert(mesh->indices.end(), { a, b, c });
+            if (r1 > 0)
+                mesh->indices.insert(mesh->indices.end(), { b, d, c });
+        }
+    };
+
+    add_frustum(0.08, 0.0, 0.06, 0.4);
+    uint32_t trunk_faces = static_cast<uint32_t>(mesh->FaceCount());
+    add_frustum(0.45, 0.3, 0.0, 0.8);
+    add_frustum(0.35, 0.6, 0.0, 1.05);
+    add_frustum(0.25, 0.85, 0.0, 1.3);
+
+    mesh->AddMaterialRange(0, trunk);
+    mesh->AddMaterialRange(trunk_faces, leaves);
+    mesh->Build();
+    return mesh;
+}
+
+// A forest on a ground plane: 10k instances of one tree mesh and of one
+// cluster of spheres, each with its own position, rotation and scale. The
+// clusters also get their own material. Only the two prototypes hold
+// geometry.
+void InstancedScene(Scene& world, View& view) {
+    auto ground_material = world.AddMaterial<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.Emplace<Sphere>(Point3(0, -1000, 0), 1000, ground_material);
+
+    auto tree = TreeMesh(world.AddMaterial<Lambertian>(Color(0.35, 0.22, 0.1)), world.AddMaterial<Lambertian>(Color(0.1, 0.4, 0.12)), 64);
+    HittableList cluster;
+    cluster.add(make_shared<Sphere>(Point3(0, 0.25, 0), 0.25, ground_material));
+    cluster.add(make_shared<Sphere>(Point3(0.3, 0.15, 0.1), 0.15, ground_material));
+    cluster.add(make_shared<Sphere>(Point3(-0.1, 0.1, 0.3), 0.1, ground_material));
+    auto cluster_bvh = make_shared<Bvh>(cluster);
+
+    size_t instances = 0;
+    for (int a = -50; a < 50; a++) {
+        for (int b = -50; b < 50; b++) {
+            Point3 position(a + 0.8 * RandomDouble(), 0, b + 0.8 * RandomDouble());
+            Real scale = Real(RandomDouble(0.6, 1.2));
+            AffineTransform transform = AffineTransform::Translation(position) * AffineTransform::Rotation(Vec3(0, 1, 0), Real(RandomDouble(0, 2 * pi)))
+                * AffineTransform::Scale(Vec3(scale, scale, scale));
+            if (RandomDouble() < 0.8) {
+                world.Emplace<Instance>(tree, transform);
+            } else {
+                auto albedo = Color::Random(0.5, 1);
+                world.Emplace<Instance>(cluster_bvh, transform, world.AddMaterial<Metal>(albedo, RandomDouble(0, 0.3)));
+            }
+            instances++;
+        }
+    }
+    std::cerr << "instances: " << instances << " instances of a " << tree->FaceCount() << "-triangle tree and a 3-sphere cluster\n";
+
+    view = View{ Point3(0, 3, 30), Point3(0, 0, 0), Vec3(0, 1, 0), 40, 0.0, 30.0 };
+}
+
+// Quad a, b, c, d as two triangles; its front face, which a DiffuseLight
+// emits from, is the side Cross(b - a, c - a) points to.
+void AddQuad(Scene& world, const Point3& a, const Point3& b, const Point3& c, const Point3& d, const Material* m) {
+    world.Emplace<Triangle>(a, b, c, m);
+    world.Emplace<Triangle>(a, c, d, m);
+}
+
+// A Cornell box, 2 units on a side and open towards the camera, lit only by
+// a square area light under its ceiling, with a diffuse and a glass sphere.
+void CornellScene(Scene& world, View& view) {
+    auto white = world.AddMaterial<Lambertian>(Color(0.73, 0.73, 0.73));
+    auto red = world.AddMaterial<Lambertian>(Color(0.65, 0.05, 0.05));
+    auto green = world.AddMaterial<Lambertian>(Color(0.12, 0.45, 0.15));
+    auto light = world.AddMaterial<DiffuseLight>(Color(12, 12, 12));
+
+    AddQuad(world, Point3(-1, 0, -1), Point3(1, 0, -1), Point3(1, 0, 1), Point3(-1, 0, 1), white);      // floor
+    AddQuad(world, Point3(-1, 2, -1), Point3(1, 2, -1), Point3(1, 2, 1), Point3(-1, 2, 1), white);      // ceiling
+    AddQuad(world, Point3(-1, 0, -1), Point3(1, 0, -1), Point3(1, 2, -1), Point3(-1, 2, -1), white);    // back
+    AddQuad(world, Point3(-1, 0, -1), Point3(-1, 2, -1), Point3(-1, 2, 1), Point3(-1, 0, 1), red);      // left
+    AddQuad(world, Point3(1, 0, -1), Point3(1, 2, -1), Point3(1, 2, 1), Point3(1, 0, 1), green);        // right
+    // Facing down, just below the ceiling.
+    AddQuad(world, Point3(-0.3, 1.98, -0.3), Point3(0.3, 1.98, -0.3), Point3(0.3, 1.98, 0.3), Point3(-0.3, 1.98, 0.3), light);
+
+    world.Emplace<Sphere>(Point3(-0.4, 0.5, -0.35), 0.5, white);
+    world.Emplace<Sphere>(Point3(0.45, 0.35, 0.35), 0.35, world.AddMaterial<Dielectric>(1.5));
+    world.sky = false;
+
+    view = View{ Point3(0, 1, 3.9), Point3(0, 1, 0), Vec3(0, 1, 0), 40, 0.0, 3.9 };
+}
+
+// A field of diffuse spheres at night, lit by 4096 small sphere lights whose
+// power spans two orders of magnitude. Paths almost never hit such lights by
+// chance, so the image depends on sampling them.
+void ManyLightsScene(Scene& world, View& view) {
+    auto ground_material = world.AddMaterial<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.Emplace<Sphere>(Point3(0, -1000, 0), 1000, ground_material);
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            Point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
+            world.Emplace<Sphere>(center, 0.2, world.AddMaterial<Lambertian>(Color::Random() * Color::Random()));
+        }
+    }
+
+    const int kLights = 4096;
+    for (int i = 0; i < kLights; i++) {
+        Point3 center(RandomDouble(-12, 12), RandomDouble(0.6, 3), RandomDouble(-12, 12));
+        Color emit = Color::Random(0.3, 1) * Real(pow(10.0, RandomDouble(-0.5, 1.5)));
+        world.Emplace<Sphere>(center, 0.03, world.AddMaterial<DiffuseLight>(emit));
+    }
+    world.sky = false;
+    std::cerr << "lights: " << kLights << " sphere lights over " << 22 * 22 << " diffuse spheres\n";
+
+    view = View{ Point3(13, 2, 3), Point3(0, 0, 0), Vec3(0, 1, 0), 20, 0.0, 10.0 };
+}
+
+const std::vector<std::string> kCanonicalScenes = { "default", "random", "triangles", "mesh" };
+
+// Fills world and view with the canonical scene called name. Mesh files are
+// added to "default" and replace the generated meshes of "mesh".
+bool BuildCanonicalScene(const std::string& name, Scene& world, View& view, const std::vector<std::string>& mesh_paths) {
+    if (name == "random") {
+        RandomScene(world, view);
+    } else if (name == "triangles") {
+        GenerateWorldWithTriangles(world, view);
+    } else if (name == "mesh") {
+        return LargeMeshScene(world, view, mesh_paths);
+    } else if (name == "instances") {
+        InstancedScene(world, view);
+    } else if (name == "cornell") {
+        CornellScene(world, view);
+    } else if (name == "lights") {
+        ManyLightsScene(world, view);
+    } else if (name == "default") {
+        DefaultScene(world, view);
+        auto material_mesh = world.AddMaterial<Lambertian>(Color(0.5, 0.5, 0.5));
+        for (const auto& path : mesh_paths) {
+            auto mesh = LoadMesh(path, material_mesh);
+            if (!mesh)
+                return false;
+            std::cerr << path << ": " << mesh->VertexCount() << " vertices, " << mesh->FaceCount() << " faces\n";
+            world.add(mesh);
+        }
+    } else {
+        std::cerr << name << ": unknown scene\n";
+        return false;
+    }
+    return true;
+}
+
+#endif // !SCENES_H
@@ -0,0 +1,205 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// SimdPack<T> holds kWidth lanes of T for the widest instruction set the
+// target enables (AVX-512, AVX, SSE2), so kernels can be written once for
+// float and double. The primary template is the one-lane scalar fallback.
+//
+// Comparisons are ordered: any lane holding NaN compares false.
+
+template <typename T>
+struct SimdPack {
+    using Mask = bool;
+    static const int kWidth = 1;
+    T v;
+
+    static SimdPack Set1(T x) { return { x }; }
+    static SimdPack Load(const T* p) { return { *p }; }
+    static SimdPack Iota() { return { T(0) }; }
+    void Store(T* p) const { *p = v; }
+
+    friend SimdPack operator+(SimdPack a, SimdPack b) { return { a.v + b.v }; }
+    friend SimdPack operator-(SimdPack a, SimdPack b) { return { a.v - b.v }; }
+    friend SimdPack operator*(SimdPack a, SimdPack b) { return { a.v * b.v }; }
+    friend SimdPack operator/(SimdPack a, SimdPack b) { return { a.v / b.v }; }
+
+    static SimdPack Sqrt(SimdPack a) { return { std::sqrt(a.v) }; }
+    static Mask CmpGe(SimdPack a, SimdPack b) { return a.v >= b.v; }
+    static Mask CmpLe(SimdPack a, SimdPack b) { return a.v <= b.v; }
+    static Mask And(Mask a, Mask b) { return a && b; }
+    static Mask Or(Mask a, Mask b) { return a || b; }
+    static bool Any(Mask m) { return m; }
+    // Lanes of a where m is set, lanes of b elsewhere.
+    static SimdPack Select(Mask m, SimdPack a, SimdPack b) { return m ? a : b; }
+};
+
+#if defined(__AVX512F__)
+
+template <>
+struct SimdPack<double> {
+    using Mask = __mmask8;
+    static const int kWidth = 8;
+    __m512d v;
+
+    static SimdPack Set1(double x) { return { _mm512_set1_pd(x) }; }
+    static SimdPack Load(const double* p) { return { _mm512_load_pd(p) }; }
+    static SimdPack Iota() { return { _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0) }; }
+    void Store(double* p) const { _mm512_store_pd(p, v); }
+
+    friend SimdPack operator+(SimdPack a, SimdPack b) { return { _mm512_add_pd(a.v, b.v) }; }
+    friend SimdPack operator-(SimdPack a, SimdPack b) { return { _mm512_sub_pd(a.v, b.v) }; }
+    friend SimdPack operator*(SimdPack a, SimdPack b) { return { _mm512_mul_pd(a.v, b.v) }; }
+    friend SimdPack operator/(SimdPack a, SimdPack b) { return { _mm512_div_pd(a.v, b.v) }; }
+
+    static SimdPack Sqrt(SimdPack a) { return { _mm512_sqrt_pd(a.v) }; }
+    static Mask CmpGe(SimdPack a, SimdPack b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_GE_OQ); }
+    static Mask CmpLe(SimdPack a, SimdPack b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LE_OQ); }
+    static Mask And(Mask a, Mask b) { return a & b; }
+    static Mask Or(Mask a, Mask b) { return a | b; }
+    static bool Any(Mask m) { return m != 0; }
+    static SimdPack Select(Mask m, SimdPack a, SimdPack b) { return { _mm512_mask_blend_pd(m, b.v, a.v) }; }
+};
+
+template <>
+struct SimdPack<float> {
+    using Mask = __mmask16;
+    static const int kWidth = 16;
+    __m512 v;
+
+    static SimdPack Set1(float x) { return { _mm512_set1_ps(x) }; }
+    static SimdPack Load(const float* p) { return { _mm512_load_ps(p) }; }
+    static SimdPack Iota() { return { _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0) }; }
+    void Store(float* p) const { _mm512_store_ps(p, v); }
+
+    friend SimdPack operator+(SimdPack a, SimdPack b) { return { _mm512_add_ps(a.v, b.v) }; }
+    friend SimdPack operator-(SimdPack a, SimdPack b) { return { _mm512_sub_ps(a.v, b.v) }; }
+    friend SimdPack operator*(SimdPack a, SimdPack b) { return { _mm512_mul_ps(a.v, b.v) }; }
+    friend SimdPack operator/(SimdPack a, SimdPack b) { return { _mm512_div_ps(a.v, b.v) }; }
+
+    static SimdPack Sqrt(SimdPack a) { return { _mm512_sqrt_ps(a.v) }; }
+    static Mask CmpGe(SimdPack a, SimdPack b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ); }
+    static Mask CmpLe(SimdPack a, SimdPack b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+    static Mask And(Mask a, Mask b) { return a & b; }
+    static Mask Or(Mask a, Mask b) { return a | b; }
+    static bool Any(Mask m) { return m != 0; }
+    static SimdPack Select(Mask m, SimdPack a, SimdPack b) { return { _mm512_mask_blend_ps(m, b.v, a.v) }; }
+};
+
+#elif defined(__AVX__)
+
+template <>
+struct SimdPack<double> {
+    using Mask = __m256d;
+    static const int kWidth = 4;
+    __m256d v;
+
+    static SimdPack Set1(double x) { return { _mm256_set1_pd(x) }; }
+    static SimdPack Load(const double* p) { return { _mm256_load_pd(p) }; }
+    static SimdPack Iota() { return { _mm256_set_pd(3, 2, 1, 0) }; }
+    void Store(double* p) const { _mm256_store_pd(p, v); }
+
+    friend SimdPack operator+(SimdPack a, SimdPack b) { return { _mm256_add_pd(a.v, b.v) }; }
+    friend SimdPack operator-(SimdPack a, SimdPack b) { return { _mm256_sub_pd(a.v, b.v) }; }
+    friend SimdPack operator*(SimdPack a, SimdPack b) { return { _mm256_mul_pd(a.v, b.v) }; }
+    friend SimdPack operator/(SimdPack a, SimdPack b) { return { _mm256_div_pd(a.v, b.v) }; }
+
+    static SimdPack Sqrt(SimdPack a) { return { _mm256_sqrt_pd(a.v) }; }
+    static Mask CmpGe(SimdPack a, SimdPack b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ); }
+    static Mask CmpLe(SimdPack a, SimdPack b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ); }
+    static Mask And(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+    static Mask Or(Mask a, Mask b) { return _mm256_or_pd(a, b); }
+    static bool Any(Mask m) { return _mm256_movemask_pd(m) != 0; }
+    static SimdPack Select(Mask m, SimdPack a, SimdPack b) { return { _mm256_blendv_pd(b.v, a.v, m) }; }
+};
+
+template <>
+struct SimdPack<float> {
+    using Mask = __m256;
+    static const int kWidth = 8;
+    __m256 v;
+
+    static SimdPack Set1(float x) { return { _mm256_set1_ps(x) }; }
+    static SimdPack Load(const float* p) { return { _mm256_load_ps(p) }; }
+    static SimdPack Iota() { return { _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0) }; }
+    void Store(float* p) const { _mm256_store_ps(p, v); }
+
+    friend SimdPack operator+(SimdPack a, SimdPack b) { return { _mm256_add_ps(a.v, b.v) }; }
+    friend SimdPack operator-(SimdPack a, SimdPack b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    friend SimdPack operator*(SimdPack a, SimdPack b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    friend SimdPack operator/(SimdPack a, SimdPack b) { return { _mm256_div_ps(a.v, b.v) }; }
+
+    static SimdPack Sqrt(SimdPack a) { return { _mm256_sqrt_ps(a.v) }; }
+    static Mask CmpGe(SimdPack a, SimdPack b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    static Mask CmpLe(SimdPack a, SimdPack b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+    static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static Mask Or(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+    static bool Any(Mask m) { return _mm256_movemask_ps(m) != 0; }
+    static SimdPack Select(Mask m, SimdPack a, SimdPack b) { return { _mm256_blendv_ps(b.v, a.v, m) }; }
+};
+
+#elif defined(SIMD_SSE2)
+
+// SSE2 has no blendv; Select uses and/andnot/or.
+
+template <>
+struct SimdPack<double> {
+    using Mask = __m128d;
+    static const int kWidth = 2;
+    __m128d v;
+
+    static SimdPack Set1(double x) { return { _mm_set1_pd(x) }; }
+    static SimdPack Load(const double* p) { return { _mm_load_pd(p) }; }
+    static SimdPack Iota() { return { _mm_set_pd(1, 0) }; }
+    void Store(double* p) const { _mm_store_pd(p, v); }
+
+    friend SimdPack operator+(SimdPack a, SimdPack b) { return { _mm_add_pd(a.v, b.v) }; }
+    friend SimdPack operator-(SimdPack a, SimdPack b) { return { _mm_sub_pd(a.v, b.v) }; }
+    friend SimdPack operator*(SimdPack a, SimdPack b) { return { _mm_mul_pd(a.v, b.v) }; }
+    friend SimdPack operator/(SimdPack a, SimdPack b) { return { _mm_div_pd(a.v, b.v) }; }
+
+    static SimdPack Sqrt(SimdPack a) { return { _mm_sqrt_pd(a.v) }; }
+    static Mask CmpGe(SimdPack a, SimdPack b) { return _mm_cmpge_pd(a.v, b.v); }
+    static Mask CmpLe(SimdPack a, SimdPack b) { return _mm_cmple_pd(a.v, b.v); }
+    static Mask And(Mask a, Mask b) { return _mm_and_pd(a, b); }
+    static Mask Or(Mask a, Mask b) { return _mm_or_pd(a, b); }
+    static bool Any(Mask m) { return _mm_movemask_pd(m) != 0; }
+    static SimdPack Select(Mask m, SimdPack a, SimdPack b) { return { _mm_or_pd(_mm_and_pd(m, a.v), _mm_andnot_pd(m, b.v)) }; }
+};
+
+template <>
+struct SimdPack<float> {
+    using Mask = __m128;
+    static const int kWidth = 4;
+    __m128 v;
+
+    static SimdPack Set1(float x) { return { _mm_set1_ps(x) }; }
+    static SimdPack Load(const float* p) { return { _mm_load_ps(p) }; }
+    static SimdPack Iota() { return { _mm_set_ps(3, 2, 1, 0) }; }
+    void Store(float* p) const { _mm_store_ps(p, v); }
+
+    friend SimdPack operator+(SimdPack a, SimdPack b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend SimdPack operator-(SimdPack a, SimdPack b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend SimdPack operator*(SimdPack a, SimdPack b) { return { _mm_mul_ps(a.v, b.v) }; }
+    friend SimdPack operator/(SimdPack a, SimdPack b) { return { _mm_div_ps(a.v, b.v) }; }
+
+    static SimdPack Sqrt(SimdPack a) { return { _mm_sqrt_ps(a.v) }; }
+    static Mask CmpGe(SimdPack a, SimdPack b) { return _mm_cmpge_ps(a.v, b.v); }
+    static Mask CmpLe(SimdPack a, SimdPack b) { return _mm_cmple_ps(a.v, b.v); }
+    static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+    static Mask Or(Mask a, Mask b) { return _mm_or_ps(a, b); }
+    static bool Any(Mask m) { return _mm_movemask_ps(m) != 0; }
+    static SimdPack Select(Mask m, SimdPack a, SimdPack b) { return { _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v)) }; }
+};
+
+#endif
+
+#endif // !SIMD_H
@@ -4,21 +4,27 @@
 #include "hittable.h"
 #include "vec3.h"
 
-class Sphere : public Hittable {
+// The material is not owned; the scene's material table keeps it alive. This
+// keeps Sphere trivially destructible, so an arena frees spheres in bulk.
+class Sphere final : public Hittable {
 public:
-    Sphere() {}
-    Sphere(Point3 cen, double r, shared_ptr<Material> m) : center_(cen), radius_(r), mat_ptr_(m) {};
+    Sphere() : Hittable(TYPE::SPHERE) {}
+    Sphere(Point3 cen, Real r, const Material* m) : Hittable(TYPE::SPHERE), center_(cen), radius_(r), mat_ptr_(m) {};
+    // Would leave the sphere pointing at a material nothing else keeps alive.
+    Sphere(Point3 cen, Real r, const shared_ptr<Material>& m) = delete;
 
-    virtual bool Hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override;
+    virtual bool Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override;
+    virtual bool Occluded(const Ray& r, Real t_min, Real t_max) const override;
+    virtual bool BoundingBox(Aabb& output_box) const override;
 
 public:
     Point3 center_;
-    double radius_;
-    shared_ptr<Material> mat_ptr_;
-    TYPE type_ = TYPE::SPHERE;
+    Real radius_;
+    const Material* mat_ptr_ = nullptr;
 };
 
-bool Sphere::Hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const {
+bool Sphere::Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
+    STATS_INC(hit_calls[static_cast<int>(TYPE::SPHERE)]);
     Vec3 oc = r.Origin() - center_;
     auto a = r.Direction().LengthSquared();
     auto half_b = Dot(oc, r.Direction());
@@ -41,8 +47,33 @@ bool Sphere::Hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const
     Vec3 outward_normal = (rec.p - center_) / radius_;
     rec.SetFaceNormal(r, outward_normal);
     rec.mat_ptr = mat_ptr_;
+    rec.object = this;
 
     return true;
 }
 
+bool Sphere::Occluded(const Ray& r, Real t_min, Real t_max) const {
+    STATS_INC(hit_calls[static_cast<int>(TYPE::SPHERE)]);
+    Vec3 oc = r.Origin() - center_;
+    auto a = r.Direction().LengthSquared();
+    auto half_b = Dot(oc, r.Direction());
+    auto c = oc.LengthSquared() - radius_ * radius_;
+
+    auto discriminant = half_b * half_b - a * c;
+    if (discriminant < 0) return false;
+    auto sqrtd = sqrt(discriminant);
+
+    // Either root in range blocks the ray.
+    auto near_root = (-half_b - sqrtd) / a;
+    auto far_root = (-half_b + sqrtd) / a;
+    return (near_root >= t_min && near_root <= t_max) || (far_root >= t_min && far_root <= t_max);
+}
+
+bool Sphere::BoundingBox(Aabb& output_box) const {
+    // A negative radius flips the normals of hollow glass spheres; the extent is the same.
+    auto r = fabs(radius_);
+    output_box = Aabb(center_ - Vec3(r, r, r), center_ + Vec3(r, r, r));
+    return true;
+}
+
 #endif
\ No newline at end of file
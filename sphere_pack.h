@@ -0,0 +1,231 @@
+#ifndef SPHERE_PACK_H
+#define SPHERE_PACK_H
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "bvh.h"
+#include "simd.h"
+
+#include <limits>
+#include <vector>
+
+// Spheres stored as cache-line sized blocks of centers and radii (structure
+// of arrays within a block), intersected SimdPack<Real>::kWidth at a time:
+// 8 doubles or 16 floats per instruction with AVX-512, 4 or 8 with AVX, 2 or
+// 4 with SSE2, one without. Only the closest sphere fills the HitRecord.
+class SpherePack : public Hittable {
+public:
+    static const int kLanes = 64 / sizeof(Real);
+
+    SpherePack() {}
+
+    void add(const Point3& center, Real radius, const Material* m);
+    size_t size() const { return count_; }
+
+    virtual bool Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override;
+    virtual bool Occluded(const Ray& r, Real t_min, Real t_max) const override;
+    virtual bool BoundingBox(Aabb& output_box) const override;
+
+private:
+    struct alignas(64) Block {
+        Real cx[kLanes];
+        Real cy[kLanes];
+        Real cz[kLanes];
+        Real radius_sq[kLanes];
+    };
+
+    // Returns the index of the closest sphere hit in [t_min, t_max], or -1.
+    int Closest(const Ray& r, Real t_min, Real t_max, Real& t_hit) const;
+
+private:
+    std::vector<Block> blocks_;
+    std::vector<Point3> centers_;
+    std::vector<Real> radii_;
+    std::vector<const Material*> materials_;
+    Aabb box_;
+    size_t count_ = 0;
+};
+
+void SpherePack::add(const Point3& center, Real radius, const Material* m) {
+    size_t lane = count_ % kLanes;
+    if (lane == 0) {
+        // Padding lanes hold NaN centers: every comparison against them is false, so they never hit.
+        Block block;
+        const Real nan = std::numeric_limits<Real>::quiet_NaN();
+        for (int i = 0; i < kLanes; i++)
+            block.cx[i] = block.cy[i] = block.cz[i] = block.radius_sq[i] = nan;
+        blocks_.push_back(block);
+    }
+
+    Block& block = blocks_.back();
+    block.cx[lane] = center.x();
+    block.cy[lane] = center.y();
+    block.cz[lane] = center.z();
+    block.radius_sq[lane] = radius * radius;
+
+    centers_.push_back(center);
+    radii_.push_back(radius);
+    materials_.push_back(m);
+
+    auto r = fabs(radius);
+    box_.Expand(Aabb(center - Vec3(r, r, r), center + Vec3(r, r, r)));
+    count_++;
+}
+
+bool SpherePack::Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
+    Real t;
+    int index = Closest(r, t_min, t_max, t);
+    if (index < 0)
+        return false;
+
+    rec.t = t;
+    rec.p = r.At(rec.t);
+    Vec3 outward_normal = (rec.p - centers_[index]) / radii_[index];
+    rec.SetFaceNormal(r, outward_normal);
+    rec.mat_ptr = materials_[index];
+    rec.object = this;
+    return true;
+}
+
+bool SpherePack::BoundingBox(Aabb& output_box) const {
+    if (count_ == 0)
+        return false;
+    output_box = box_;
+    return true;
+}
+
+int SpherePack::Closest(const Ray& r, Real t_min, Real t_max, Real& t_hit) const {
+    using Pack = SimdPack<Real>;
+    STATS_ADD(hit_calls[static_cast<int>(TYPE::SPHERE)], count_);
+
+    const Pack ox = Pack::Set1(r.orig.x()), oy = Pack::Set1(r.orig.y()), oz = Pack::Set1(r.orig.z());
+    const Pack dx = Pack::Set1(r.dir.x()), dy = Pack::Set1(r.dir.y()), dz = Pack::Set1(r.dir.z());
+    const Pack a = Pack::Set1(r.dir.LengthSquared());
+    const Pack lo = Pack::Set1(t_min);
+    const Pack zero = Pack::Set1(0);
+    const Pack lane_offsets = Pack::Iota();
+
+    // Every lane keeps its own closest hit; they are reduced once at the end.
+    Pack best_t = Pack::Set1(t_max);
+    Pack best_i = Pack::Set1(-1);
+
+    for (size_t b = 0; b < blocks_.size(); b++) {
+        const Block& block = blocks_[b];
+        for (int h = 0; h < kLanes; h += Pack::kWidth) {
+            Pack ocx = ox - Pack::Load(block.cx + h);
+            Pack ocy = oy - Pack::Load(block.cy + h);
+            Pack ocz = oz - Pack::Load(block.cz + h);
+            Pack half_b = ocx * dx + ocy * dy + ocz * dz;
+            Pack c = ocx * ocx + ocy * ocy + ocz * ocz - Pack::Load(block.radius_sq + h);
+            Pack disc = half_b * half_b - a * c;
+            auto valid = Pack::CmpGe(disc, zero);
+            if (!Pack::Any(valid))
+                continue;
+
+            // Same root selection as Sphere::Hit: the near root if it is in range, else the far one.
+            Pack sqrtd = Pack::Sqrt(disc);
+            Pack neg_b = zero - half_b;
+            Pack t0 = (neg_b - sqrtd) / a;
+            Pack t1 = (neg_b + sqrtd) / a;
+            auto m0 = Pack::And(Pack::CmpGe(t0, lo), Pack::CmpLe(t0, best_t));
+            auto m1 = Pack::And(Pack::CmpGe(t1, lo), Pack::CmpLe(t1, best_t));
+            auto m = Pack::And(Pack::Or(m0, m1), valid);
+            Pack t = Pack::Select(m0, t0, t1);
+
+            Pack index = Pack::Set1(static_cast<Real>(b * kLanes + h)) + lane_offsets;
+            best_t = Pack::Select(m, t, best_t);
+            best_i = Pack::Select(m, index, best_i);
+        }
+    }
+
+    alignas(64) Real ts[Pack::kWidth], is[Pack::kWidth];
+    best_t.Store(ts);
+    best_i.Store(is);
+    int best = -1;
+    for (int i = 0; i < Pack::kWidth; i++) {
+        if (is[i] >= 0 && (best < 0 || ts[i] < t_hit)) {
+            best = static_cast<int>(is[i]);
+            t_hit = ts[i];
+        }
+    }
+    return best;
+}
+
+// Same lane tests as Closest(), returning after the first group of lanes
+// with any hit in range.
+bool SpherePack::Occluded(const Ray& r, Real t_min, Real t_max) const {
+    using Pack = SimdPack<Real>;
+
+    const Pack ox = Pack::Set1(r.orig.x()), oy = Pack::Set1(r.orig.y()), oz = Pack::Set1(r.orig.z());
+    const Pack dx = Pack::Set1(r.dir.x()), dy = Pack::Set1(r.dir.y()), dz = Pack::Set1(r.dir.z());
+    const Pack a = Pack::Set1(r.dir.LengthSquared());
+    const Pack lo = Pack::Set1(t_min), hi = Pack::Set1(t_max);
+    const Pack zero = Pack::Set1(0);
+
+    for (size_t b = 0; b < blocks_.size(); b++) {
+        const Block& block = blocks_[b];
+        for (int h = 0; h < kLanes; h += Pack::kWidth) {
+            STATS_ADD(hit_calls[static_cast<int>(TYPE::SPHERE)], Pack::kWidth);
+            Pack ocx = ox - Pack::Load(block.cx + h);
+            Pack ocy = oy - Pack::Load(block.cy + h);
+            Pack ocz = oz - Pack::Load(block.cz + h);
+            Pack half_b = ocx * dx + ocy * dy + ocz * dz;
+            Pack c = ocx * ocx + ocy * ocy + ocz * ocz - Pack::Load(block.radius_sq + h);
+            Pack disc = half_b * half_b - a * c;
+            auto valid = Pack::CmpGe(disc, zero);
+            if (!Pack::Any(valid))
+                continue;
+
+            Pack sqrtd = Pack::Sqrt(disc);
+            Pack neg_b = zero - half_b;
+            Pack t0 = (neg_b - sqrtd) / a;
+            Pack t1 = (neg_b + sqrtd) / a;
+            auto m0 = Pack::And(Pack::CmpGe(t0, lo), Pack::CmpLe(t0, hi));
+            auto m1 = Pack::And(Pack::CmpGe(t1, lo), Pack::CmpLe(t1, hi));
+            if (Pack::Any(Pack::And(Pack::Or(m0, m1), valid)))
+                return true;
+        }
+    }
+    return false;
+}
+
+// Replaces the Spheres of a list by SpherePacks of up to pack_size spatially
+// close spheres, so a BVH over the result ends in SIMD-tested leaves. Other
+// objects, and spheres that are lights, are kept as they are: the light
+// sampler finds a light by the Sphere that was hit.
+HittableList PackSpheres(const HittableList& list, size_t pack_size = 2 * SpherePack::kLanes) {
+    HittableList packed;
+    std::vector<const Sphere*> spheres;
+    std::vector<Aabb> boxes;
+
+    for (const auto& object : list.objects) {
+        auto sphere = dynamic_cast<const Sphere*>(object.get());
+        Aabb box;
+        if (sphere && sphere->BoundingBox(box) && !(sphere->mat_ptr_ && sphere->mat_ptr_->type_ == MaterialType::EMISSIVE)) {
+            spheres.push_back(sphere);
+            boxes.push_back(box);
+        } else {
+            packed.add(object);
+        }
+    }
+
+    // Leaf order of a BVH over the spheres keeps neighbours together.
+    BvhTree tree;
+    auto order = tree.Build(boxes);
+
+    shared_ptr<SpherePack> pack;
+    for (int index : order) {
+        if (!pack || pack->size() == pack_size) {
+            pack = make_shared<SpherePack>();
+            packed.add(pack);
+        }
+        const Sphere* sphere = spheres[index];
+        pack->add(sphere->center_, sphere->radius_, sphere->mat_ptr_);
+    }
+
+    return packed;
+}
+
+#endif // !SPHERE_PACK_H
@@ -0,0 +1,153 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Optional hot-path instrumentation. Build with RAYTRACER_STATS to count, per
+// thread, the rays traced, Hit calls per primitive type, BVH nodes visited,
+// Scatter calls per material, shadow rays and path depths, and to record the
+// render time of every pixel. Without it the STATS_* macros expand to nothing
+// and none of this is compiled.
+//
+//   STATS_INC(field)      adds one to a counter of the calling thread
+//   STATS_ADD(field, n)   adds n
+//   STATS_ONLY(code)      code that exists only in instrumented builds
+
+#ifdef RAYTRACER_STATS
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define STATS_INC(field) (++ThreadCounters().field)
+#define STATS_ADD(field, n) (ThreadCounters().field += (n))
+#define STATS_ONLY(...) __VA_ARGS__
+
+// Array sizes follow enum class TYPE (hittable.h), up to MESH, and MaterialType (material.h).
+const int kStatsPrimitiveTypes = 3;
+const int kStatsMaterialTypes = 5;
+const int kStatsMaxDepth = 64; // deeper paths share the last histogram bucket
+
+struct alignas(64) RenderCounters {
+    uint64_t rays = 0;
+    uint64_t hit_calls[kStatsPrimitiveTypes] = {};   // spheres in a SpherePack count one each
+    uint64_t bvh_nodes = 0;
+    uint64_t scatter_calls[kStatsMaterialTypes] = {};
+    uint64_t shadow_rays = 0;                       // next-event estimation, not counted in rays
+    uint64_t path_depth[kStatsMaxDepth + 1] = {};   // paths by number of rays traced
+
+    void Add(const RenderCounters& other) {
+        rays += other.rays;
+        for (int i = 0; i < kStatsPrimitiveTypes; i++)
+            hit_calls[i] += other.hit_calls[i];
+        bvh_nodes += other.bvh_nodes;
+        for (int i = 0; i < kStatsMaterialTypes; i++)
+            scatter_calls[i] += other.scatter_calls[i];
+        shadow_rays += other.shadow_rays;
+        for (int i = 0; i <= kStatsMaxDepth; i++)
+            path_depth[i] += other.path_depth[i];
+    }
+};
+
+// Counters of every thread that ever counted, plus the per-pixel cost of the
+// current image. Counters are only summed once rendering is over, so the hot
+// path never shares a cache line between threads.
+struct StatsRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<RenderCounters>> threads;
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixel_ns;  // row 0 is the bottom scanline, like Framebuffer
+};
+
+inline StatsRegistry& Stats() {
+    static StatsRegistry registry;
+    return registry;
+}
+
+inline RenderCounters& ThreadCounters() {
+    thread_local RenderCounters* counters = [] {
+        auto& registry = Stats();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.threads.push_back(std::make_unique<RenderCounters>());
+        return registry.threads.back().get();
+    }();
+    return *counters;
+}
+
+// Clears all counters and sizes the cost map; call before a render.
+inline void StatsBeginImage(int width, int height) {
+    auto& registry = Stats();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto& counters : registry.threads)
+        *counters = RenderCounters();
+    registry.width = width;
+    registry.height = height;
+    registry.pixel_ns.assign(static_cast<size_t>(width) * height, 0.0f);
+}
+
+// Pixels are written by exactly one tile, so no locking is needed.
+inline void StatsRecordPixel(int i, int j, double ns) {
+    auto& registry = Stats();
+    registry.pixel_ns[static_cast<size_t>(j) * registry.width + i] = static_cast<float>(ns);
+}
+
+// Spreads a tile's time evenly over its pixels, for renderers that do not
+// finish pixels one at a time.
+template <typename TileT>
+inline void StatsRecordTile(const TileT& tile, double seconds) {
+    double ns = 1e9 * seconds / std::max(1, (tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+    for (int j = tile.y0; j < tile.y1; j++)
+        for (int i = tile.x0; i < tile.x1; i++)
+            StatsRecordPixel(i, j, ns);
+}
+
+inline RenderCounters StatsTotal() {
+    auto& registry = Stats();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    RenderCounters total;
+    for (const auto& counters : registry.threads)
+        total.Add(*counters);
+    return total;
+}
+
+inline void ReportStats(std::ostream& out) {
+    RenderCounters total = StatsTotal();
+    const char* primitive_names[kStatsPrimitiveTypes] = { "sphere", "triangle", "mesh" };
+    const char* material_names[kStatsMaterialTypes] = { "lambertian", "metal", "dielectric", "emissive", "other" };
+
+    out << "Stats:\n";
+    out << "  rays traced: " << total.rays << "\n";
+    out << "  bvh nodes visited: " << total.bvh_nodes;
+    if (total.rays > 0)
+        out << " (" << double(total.bvh_nodes) / total.rays << " per ray)";
+    out << "\n";
+    for (int i = 0; i < kStatsPrimitiveTypes; i++)
+        out << "  hit calls, " << primitive_names[i] << ": " << total.hit_calls[i] << "\n";
+    for (int i = 0; i < kStatsMaterialTypes; i++)
+        out << "  scatter calls, " << material_names[i] << ": " << total.scatter_calls[i] << "\n";
+    out << "  shadow rays: " << total.shadow_rays << "\n";
+
+    uint64_t paths = 0;
+    int deepest = 0;
+    for (int d = 0; d <= kStatsMaxDepth; d++) {
+        paths += total.path_depth[d];
+        if (total.path_depth[d] > 0)
+            deepest = d;
+    }
+    out << "  path depth (rays per path):\n";
+    for (int d = 1; d <= deepest; d++)
+        out << "    " << d << (d == kStatsMaxDepth ? "+" : "") << ": " << total.path_depth[d]
+            << " (" << (paths ? 100.0 * total.path_depth[d] / paths : 0.0) << "%)\n";
+}
+
+#else
+
+#define STATS_INC(field) ((void)0)
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_ONLY(...)
+
+#endif // RAYTRACER_STATS
+
+#endif // !STATS_H
@@ -2,28 +2,30 @@
 #define STOPWATCH_H
 
 #include <chrono>
+#include <cstdint>
 #include <string>
 #include <iostream>
 
 class StopWatch {
 	public:
 		void Begin();
-		double Stop();
+		// Seconds since Begin(), at the full resolution of the clock.
+		double Stop() const;
+		int64_t ElapsedNanoseconds() const;
 	private:
-		std::chrono::time_point<std::chrono::high_resolution_clock> start_time_;
+		std::chrono::time_point<std::chrono::steady_clock> start_time_;
 };
 
 void StopWatch::Begin() {
-	start_time_ = std::chrono::high_resolution_clock::now();
+	start_time_ = std::chrono::steady_clock::now();
 }
 
-double StopWatch::Stop() {
-	auto end_time = std::chrono::high_resolution_clock::now();
-
-	auto start = std::chrono::time_point_cast<std::chrono::seconds>(start_time_).time_since_epoch().count();
-	auto end = std::chrono::time_point_cast<std::chrono::seconds>(end_time).time_since_epoch().count();
+double StopWatch::Stop() const {
+	return ElapsedNanoseconds() * 1e-9;
+}
 
-	double duration =  static_cast<double>(end - start);
-	return duration;
+int64_t StopWatch::ElapsedNanoseconds() const {
+	auto end_time = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time_).count();
 }
 #endif // !STOPWATCH_H
@@ -0,0 +1,144 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads. Every worker owns a queue of task indices;
+// it pops from the back of its own queue and, once that runs dry, steals from
+// the front of the other workers' queues.
+class ThreadPool {
+public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int NumThreads() const { return static_cast<int>(workers_.size()); }
+
+    // Runs task(index, worker_id) for every index in [0, count) and blocks until all of them have finished.
+    void ParallelFor(int count, const std::function<void(int, int)>& task);
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<int> indices;
+    };
+
+    void WorkerLoop(int worker_id);
+    bool PopLocal(int worker_id, int& index);
+    bool Steal(int worker_id, int& index);
+
+private:
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    const std::function<void(int, int)>* task_ = nullptr;
+    std::atomic<int> remaining_{ 0 };
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    unsigned generation_ = 0;
+    bool stop_ = false;
+};
+
+ThreadPool::ThreadPool(int num_threads) {
+    if (num_threads < 1)
+        num_threads = 1;
+
+    for (int i = 0; i < num_threads; ++i)
+        queues_.push_back(std::make_unique<WorkQueue>());
+    for (int i = 0; i < num_threads; ++i)
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int, int)>& task) {
+    if (count <= 0)
+        return;
+
+    // Publish the task before any index becomes visible: workers only read task_
+    // after taking a queue mutex, which orders them after this store.
+    task_ = &task;
+    remaining_ = count;
+
+    int num_queues = static_cast<int>(queues_.size());
+    for (int i = 0; i < count; ++i) {
+        auto& queue = *queues_[i % num_queues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.indices.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++generation_;
+    }
+    work_cv_.notify_all();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return remaining_.load() == 0; });
+}
+
+void ThreadPool::WorkerLoop(int worker_id) {
+    unsigned seen_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [&] { return stop_ || generation_ != seen_generation; });
+            if (stop_)
+                return;
+            seen_generation = generation_;
+        }
+
+        int index;
+        while (PopLocal(worker_id, index) || Steal(worker_id, index)) {
+            (*task_)(index, worker_id);
+            if (remaining_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                done_cv_.notify_all();
+            }
+        }
+    }
+}
+
+bool ThreadPool::PopLocal(int worker_id, int& index) {
+    auto& queue = *queues_[worker_id];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.indices.empty())
+        return false;
+    index = queue.indices.back();
+    queue.indices.pop_back();
+    return true;
+}
+
+bool ThreadPool::Steal(int worker_id, int& index) {
+    int num_queues = static_cast<int>(queues_.size());
+    for (int offset = 1; offset < num_queues; ++offset) {
+        auto& victim = *queues_[(worker_id + offset) % num_queues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.indices.empty()) {
+            index = victim.indices.front();
+            victim.indices.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // !THREAD_POOL_H
@@ -2,98 +2,171 @@
 #define TRIANGLE_H
 
 #include "hittable.h"
-#include "matrix3.h"
 
-class Triangle : public Hittable {
+#include <utility>
+
+// Define TRIANGLE_WATERTIGHT to use the watertight test of Woop, Benthin and
+// Wald (2013), which never lets a ray slip through the shared edge of two
+// triangles, at roughly twice the cost of Moller-Trumbore.
+
+// Ray/triangle tests shared by Triangle and TriangleMesh. On a hit inside
+// [t_min, t_max] they return t and the barycentric weights (u, v) of b and c.
+
+inline bool RayTriangleMollerTrumbore(const Ray& r, const Point3& a, const Vec3& edge1, const Vec3& edge2,
+	Real t_min, Real t_max, Real& t, Real& u, Real& v) {
+	const Real kEpsilon = Real(1e-12);
+
+	Vec3 pvec = Cross(r.Direction(), edge2);
+	Real det = Dot(edge1, pvec);
+
+	// Ray parallel to the triangle plane, or a degenerate triangle.
+	if (fabs(det) < kEpsilon)
+		return false;
+	Real inv_det = 1 / det;
+
+	Vec3 tvec = r.Origin() - a;
+	u = Dot(tvec, pvec) * inv_det;
+	if (u < 0.0 || u > 1.0)
+		return false;
+
+	Vec3 qvec = Cross(tvec, edge1);
+	v = Dot(r.Direction(), qvec) * inv_det;
+	if (v < 0.0 || u + v > 1.0)
+		return false;
+
+	t = Dot(edge2, qvec) * inv_det;
+	return t >= t_min && t <= t_max;
+}
+
+inline bool RayTriangleWatertight(const Ray& r, const Point3& a, const Point3& b, const Point3& c,
+	Real t_min, Real t_max, Real& t, Real& u, Real& v) {
+	Vec3 dir = r.Direction();
+
+	// Permute axes so the dominant direction component becomes z, keeping the winding.
+	int kz = 0;
+	if (fabs(dir.y()) > fabs(dir[kz])) kz = 1;
+	if (fabs(dir.z()) > fabs(dir[kz])) kz = 2;
+	int kx = (kz + 1) % 3;
+	int ky = (kx + 1) % 3;
+	if (dir[kz] < 0.0) std::swap(kx, ky);
+
+	// Shear so the ray points along +z.
+	Real sz = 1 / dir[kz];
+	Real sx = dir[kx] * sz;
+	Real sy = dir[ky] * sz;
+
+	Vec3 pa = a - r.Origin(), pb = b - r.Origin(), pc = c - r.Origin();
+
+	Real ax = pa[kx] - sx * pa[kz], ay = pa[ky] - sy * pa[kz];
+	Real bx = pb[kx] - sx * pb[kz], by = pb[ky] - sy * pb[kz];
+	Real cx = pc[kx] - sx * pc[kz], cy = pc[ky] - sy * pc[kz];
+
+	// Scaled barycentrics; an edge through the ray yields exactly zero.
+	Real wa = cx * by - cy * bx;
+	Real wb = ax * cy - ay * cx;
+	Real wc = bx * ay - by * ax;
+
+	// In single precision an edge can round to exactly zero; redo the edge tests in double there.
+	if (sizeof(Real) < sizeof(double) && (wa == 0 || wb == 0 || wc == 0)) {
+		wa = Real(double(cx) * double(by) - double(cy) * double(bx));
+		wb = Real(double(ax) * double(cy) - double(ay) * double(cx));
+		wc = Real(double(bx) * double(ay) - double(by) * double(ax));
+	}
+
+	if ((wa < 0.0 || wb < 0.0 || wc < 0.0) && (wa > 0.0 || wb > 0.0 || wc > 0.0))
+		return false;
+
+	Real det = wa + wb + wc;
+	if (det == 0.0)
+		return false;
+
+	Real inv_det = 1 / det;
+	t = (wa * pa[kz] + wb * pb[kz] + wc * pc[kz]) * sz * inv_det;
+	if (t < t_min || t > t_max)
+		return false;
+
+	u = wb * inv_det;
+	v = wc * inv_det;
+	return true;
+}
+
+// Each variant reads either the vertices or the precomputed edges.
+inline bool RayTriangle(const Ray& r, const Point3& a, [[maybe_unused]] const Point3& b, [[maybe_unused]] const Point3& c,
+	[[maybe_unused]] const Vec3& edge1, [[maybe_unused]] const Vec3& edge2, Real t_min, Real t_max, Real& t, Real& u, Real& v) {
+#ifdef TRIANGLE_WATERTIGHT
+	return RayTriangleWatertight(r, a, b, c, t_min, t_max, t, u, v);
+#else
+	return RayTriangleMollerTrumbore(r, a, edge1, edge2, t_min, t_max, t, u, v);
+#endif
+}
+
+// Like Sphere, a Triangle does not own its material.
+class Triangle final : public Hittable {
 	public:
-		Triangle(const Point3& a, const Point3& b, const Point3& c, shared_ptr<Material> m) {
+		// Would leave the triangle pointing at a material nothing else keeps alive.
+		Triangle(const Point3& a, const Point3& b, const Point3& c, const shared_ptr<Material>& m) = delete;
+		Triangle(const Point3& a, const Point3& b, const Point3& c, const Material* m) : Hittable(TYPE::TRIANGLE) {
 			a_ = a;
 			b_ = b;
 			c_ = c;
 			mat_ptr_ = m;
+
+			// Per-triangle data reused by every ray.
+			edge1_ = b_ - a_;
+			edge2_ = c_ - a_;
+			Vec3 n = Cross(edge1_, edge2_);
+			normal_ = n.NearZero() ? n : UnitVector(n);
 		}
 
 		Point3 a() const { return a_; }
 		Point3 b() const { return b_; }
 		Point3 c() const { return c_; }
 
-		bool Hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override;
+		bool Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override;
+		bool Occluded(const Ray& r, Real t_min, Real t_max) const override;
+		bool BoundingBox(Aabb& output_box) const override;
 
 	public:
 		Point3 a_;
 		Point3 b_;
 		Point3 c_;
-		shared_ptr<Material> mat_ptr_;
-		TYPE type_ = TYPE::TRIANGLE;
+		Vec3 edge1_;
+		Vec3 edge2_;
+		Vec3 normal_;
+		const Material* mat_ptr_ = nullptr;
 };
 
 
-bool Triangle::Hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const {
-	bool hit = false;
-	double beta = 0.0, gamma = 0.0, t = 0.0;
-	Point3 e = r.Origin();
-	Point3 d = r.Direction();
-	Point3 intersection;
-
-	double xa_xe = a_.x() - e.x(), xa_xc = a_.x() - c_.x(), xd = d.x();
-	double ya_ye = a_.y() - e.y(), ya_yc = a_.y() - c_.y(), yd = d.y();
-	double za_ze = a_.z() - e.z(), za_zc = a_.z() - c_.z(), zd = d.z();
-
-	double xa_xb = a_.x() - b_.x();
-	double ya_yb = a_.y() - b_.y();
-	double za_zb = a_.z() - b_.z();
-
-
-	Matrix3 beta_mat{ xa_xe, xa_xc, xd,
-					  ya_ye, ya_yc, yd,
-					  za_ze, za_zc, zd
-	};
-
-	Matrix3 gamma_mat{ xa_xb, xa_xe, xd,
-					   ya_yb, ya_ye, yd,
-					   za_zb, za_ze, zd
-	};
-
-	Matrix3 t_mat{ xa_xb, xa_xc, xa_xe,
-				   ya_yb, ya_yc, ya_ye,
-				   za_zb, za_zc, za_ze
-	};
-
-
-	Matrix3 A{ a_.x() - b_.x(), a_.x() - c_.x(), d.x(),
-			   a_.y() - b_.y(), a_.y() - c_.y(), d.y(),
-			   a_.z() - b_.z(), a_.z() - c_.z(), d.z() };
+bool Triangle::Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
+	STATS_INC(hit_calls[static_cast<int>(TYPE::TRIANGLE)]);
+	Real t, u, v;
+	if (!RayTriangle(r, a_, b_, c_, edge1_, edge2_, t_min, t_max, t, u, v))
+		return false;
 
-	// Solve for beta, gamma and t
+	rec.t = t;
+	rec.p = r.At(rec.t);
+	rec.u = u;
+	rec.v = v;
+	rec.SetFaceNormal(r, normal_);
+	rec.mat_ptr = mat_ptr_;
+	rec.object = this;
 
-	double det_a = Determinant(A);
-
-	beta = Determinant(beta_mat) / det_a;
-	gamma = Determinant(gamma_mat) / det_a;
-	t = Determinant(t_mat) / det_a;
-
-	if (beta > 0 && gamma > 0 && (beta + gamma) < 1) {
-		intersection = a_ + beta * (b_ - a_) + gamma * (c_ - a_);
-		hit = true;
-
-		// Compute triangle normal
-		Vec3 U = b_ - a_, V = c_ - a_;
-
-		auto nx = (U.y() * V.z()) - (U.z() * V.y());
-		auto ny = (U.z() * V.x()) - (U.x() * V.z());
-		auto nz = (U.x() * V.y()) - (U.y() * V.x());
-
-		Vec3 N = Vec3(nx,ny,nz);
-		
-		rec.t = t;
-		rec.p = r.At(rec.t);
-		rec.normal = N;
-		rec.mat_ptr = mat_ptr_;
+	return true;
+}
 
-	}
+bool Triangle::Occluded(const Ray& r, Real t_min, Real t_max) const {
+	STATS_INC(hit_calls[static_cast<int>(TYPE::TRIANGLE)]);
+	Real t, u, v;
+	return RayTriangle(r, a_, b_, c_, edge1_, edge2_, t_min, t_max, t, u, v);
+}
 
-	return hit;
+bool Triangle::BoundingBox(Aabb& output_box) const {
+	output_box = Aabb();
+	output_box.Expand(a_);
+	output_box.Expand(b_);
+	output_box.Expand(c_);
+	output_box.Pad();
+	return true;
 }
 
 #endif // !TRIANGLE_H
-
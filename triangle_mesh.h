@@ -0,0 +1,245 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "hittable.h"
+#include "triangle.h"
+#include "bvh.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct TexCoord {
+    Real u, v;
+};
+
+// Indexed triangle mesh. All faces share one vertex buffer and are found
+// through an internal BVH, so a face costs 12 bytes of indices instead of a
+// heap-allocated Triangle.
+//
+// Fill the buffers, assign materials, then call Build() once before rendering.
+// Like Sphere and Triangle, the mesh does not own its materials.
+class TriangleMesh : public Hittable {
+public:
+    TriangleMesh() : Hittable(TYPE::MESH) {}
+
+    size_t VertexCount() const { return positions.size(); }
+    size_t FaceCount() const { return indices.size() / 3; }
+
+    // Faces are tagged with 16-bit indices into the distinct materials.
+    static const size_t kMaxMaterials = 65536;
+
+    // Uses one material for every face.
+    void SetMaterial(const Material* m);
+
+    // Faces from first_face up to the next range's first face use m. Ranges
+    // must be added in increasing first_face order.
+    void AddMaterialRange(uint32_t first_face, const Material* m);
+
+    // Builds the face BVH. Faces are reordered into leaf order. Returns false
+    // if the faces use more than kMaxMaterials distinct materials.
+    bool Build();
+
+    // Like Build(), for faces already in the leaf order of a face BVH saved
+    // from an earlier Build(): adopts its nodes and refits their boxes to the
+    // current positions. Also returns false if the nodes do not fit the mesh.
+    bool Build(std::vector<BvhNode> nodes);
+
+    // Material of face f, in the current face order.
+    const Material* FaceMaterial(size_t f) const { return materials_[face_material_.empty() ? 0 : face_material_[f]]; }
+    const BvhTree& Tree() const { return tree_; }
+
+    virtual bool Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override;
+    virtual bool Occluded(const Ray& r, Real t_min, Real t_max) const override;
+    virtual bool BoundingBox(Aabb& output_box) const override;
+
+public:
+    std::vector<Point3> positions;
+    std::vector<Vec3> normals;   // optional, one per vertex
+    std::vector<TexCoord> uvs;   // optional, one per vertex
+    std::vector<uint32_t> indices;
+
+private:
+    // Resolves the material ranges into the distinct materials_ and the
+    // material index of every face, left empty when all faces share one
+    // material. Returns false if there are more than kMaxMaterials.
+    bool ResolveMaterials(std::vector<uint16_t>& face_material);
+    std::vector<Aabb> FaceBoxes() const;
+
+private:
+    struct MaterialRange {
+        uint32_t first_face;
+        const Material* material;
+    };
+
+    std::vector<MaterialRange> ranges_;
+    std::vector<const Material*> materials_;
+    std::vector<uint16_t> face_material_; // per face, only when there is more than one material
+    BvhTree tree_;
+};
+
+void TriangleMesh::SetMaterial(const Material* m) {
+    ranges_.clear();
+    ranges_.push_back(MaterialRange{ 0, m });
+}
+
+void TriangleMesh::AddMaterialRange(uint32_t first_face, const Material* m) {
+    if (!ranges_.empty() && ranges_.back().first_face == first_face)
+        ranges_.back().material = m;
+    else
+        ranges_.push_back(MaterialRange{ first_face, m });
+}
+
+bool TriangleMesh::ResolveMaterials(std::vector<uint16_t>& face_material) {
+    size_t face_count = FaceCount();
+    materials_.clear();
+    face_material_.clear();
+    face_material.clear();
+
+    // A material switched back to, as in an OBJ file, keeps its first index.
+    std::unordered_map<const Material*, size_t> index;
+    std::vector<size_t> range_material(ranges_.size());
+    for (size_t i = 0; i < ranges_.size(); i++) {
+        auto it = index.emplace(ranges_[i].material, materials_.size()).first;
+        if (it->second == materials_.size())
+            materials_.push_back(ranges_[i].material);
+        range_material[i] = it->second;
+    }
+    if (materials_.size() > kMaxMaterials)
+        return false;
+    if (materials_.empty())
+        materials_.push_back(nullptr);
+
+    if (materials_.size() > 1) {
+        face_material.resize(face_count, 0);
+        for (size_t i = 0; i < ranges_.size(); i++) {
+            size_t end = i + 1 < ranges_.size() ? ranges_[i + 1].first_face : face_count;
+            for (size_t f = ranges_[i].first_face; f < end && f < face_count; f++)
+                face_material[f] = static_cast<uint16_t>(range_material[i]);
+        }
+    }
+    return true;
+}
+
+std::vector<Aabb> TriangleMesh::FaceBoxes() const {
+    size_t face_count = FaceCount();
+    std::vector<Aabb> boxes(face_count);
+    for (size_t f = 0; f < face_count; f++) {
+        boxes[f].Expand(positions[indices[3 * f]]);
+        boxes[f].Expand(positions[indices[3 * f + 1]]);
+        boxes[f].Expand(positions[indices[3 * f + 2]]);
+        boxes[f].Pad();
+    }
+    return boxes;
+}
+
+bool TriangleMesh::Build() {
+    size_t face_count = FaceCount();
+    std::vector<uint16_t> face_material;
+    if (!ResolveMaterials(face_material))
+        return false;
+    std::vector<Aabb> boxes = FaceBoxes();
+
+    auto order = tree_.Build(boxes);
+    boxes.clear();
+    boxes.shrink_to_fit();
+
+    std::vector<uint32_t> sorted(indices.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        size_t f = static_cast<size_t>(order[i]);
+        sorted[3 * i] = indices[3 * f];
+        sorted[3 * i + 1] = indices[3 * f + 1];
+        sorted[3 * i + 2] = indices[3 * f + 2];
+    }
+    indices.swap(sorted);
+
+    if (!face_material.empty()) {
+        face_material_.resize(face_count);
+        for (size_t i = 0; i < order.size(); i++)
+            face_material_[i] = face_material[order[i]];
+    }
+    return true;
+}
+
+bool TriangleMesh::Build(std::vector<BvhNode> nodes) {
+    if (!ResolveMaterials(face_material_))
+        return false;
+    if (!tree_.Adopt(std::move(nodes), static_cast<int>(FaceCount())))
+        return false;
+    tree_.Refit(FaceBoxes());
+    return true;
+}
+
+bool TriangleMesh::Hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
+    STATS_INC(hit_calls[static_cast<int>(TYPE::MESH)]);
+    int hit_face = -1;
+    Real hit_t = 0, hit_u = 0, hit_v = 0;
+
+    tree_.Intersect(r, t_min, t_max, [&](int f, Real t_lo, Real& t_hi) {
+        const Point3& a = positions[indices[3 * f]];
+        const Point3& b = positions[indices[3 * f + 1]];
+        const Point3& c = positions[indices[3 * f + 2]];
+        STATS_INC(hit_calls[static_cast<int>(TYPE::TRIANGLE)]);
+        Real t, u, v;
+        if (!RayTriangle(r, a, b, c, b - a, c - a, t_lo, t_hi, t, u, v))
+            return false;
+        t_hi = t;
+        hit_face = f;
+        hit_t = t;
+        hit_u = u;
+        hit_v = v;
+        return true;
+    });
+
+    if (hit_face < 0)
+        return false;
+
+    // Fill the record once, for the closest face only.
+    uint32_t i0 = indices[3 * hit_face], i1 = indices[3 * hit_face + 1], i2 = indices[3 * hit_face + 2];
+    const Point3& a = positions[i0];
+    Vec3 geometric_normal = UnitVector(Cross(positions[i1] - a, positions[i2] - a));
+    Real w = 1 - hit_u - hit_v;
+
+    rec.t = hit_t;
+    rec.p = r.At(hit_t);
+    rec.SetFaceNormal(r, geometric_normal);
+
+    if (!normals.empty()) {
+        // Interpolated shading normal, flipped to the side the geometric normal faces.
+        Vec3 n = UnitVector(w * normals[i0] + hit_u * normals[i1] + hit_v * normals[i2]);
+        rec.normal = Dot(n, rec.normal) < 0 ? -n : n;
+    }
+
+    if (!uvs.empty()) {
+        rec.u = w * uvs[i0].u + hit_u * uvs[i1].u + hit_v * uvs[i2].u;
+        rec.v = w * uvs[i0].v + hit_u * uvs[i1].v + hit_v * uvs[i2].v;
+    } else {
+        rec.u = hit_u;
+        rec.v = hit_v;
+    }
+
+    rec.mat_ptr = materials_[face_material_.empty() ? 0 : face_material_[hit_face]];
+    rec.object = this;
+    return true;
+}
+
+bool TriangleMesh::Occluded(const Ray& r, Real t_min, Real t_max) const {
+    STATS_INC(hit_calls[static_cast<int>(TYPE::MESH)]);
+    return tree_.Occluded(r, t_min, t_max, [&](int f, Real t_lo, Real t_hi) {
+        const Point3& a = positions[indices[3 * f]];
+        const Point3& b = positions[indices[3 * f + 1]];
+        const Point3& c = positions[indices[3 * f + 2]];
+        STATS_INC(hit_calls[static_cast<int>(TYPE::TRIANGLE)]);
+        Real t, u, v;
+        return RayTriangle(r, a, b, c, b - a, c - a, t_lo, t_hi, t, u, v);
+    });
+}
+
+bool TriangleMesh::BoundingBox(Aabb& output_box) const {
+    if (tree_.Empty())
+        return false;
+    output_box = tree_.Bounds();
+    return true;
+}
+
+#endif // !TRIANGLE_MESH_H
@@ -6,6 +6,8 @@
 #include <limits>
 #include <memory>
 
+#include "random.h"
+
 // Usings
 
 using std::shared_ptr;
@@ -27,7 +29,7 @@ inline double Clamp(double x, double min, double max) {
 
 inline double RandomDouble() {
     // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    return ThreadRandomState().rng.NextDouble();
 }
 
 inline double RandomDouble(double min, double max) {
@@ -0,0 +1,225 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "renderer.h"
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Wavefront execution of a tile. Instead of following one path to the end,
+// all camera samples of the tile are generated up front and every bounce runs
+// as passes over the whole batch:
+//
+//   1. intersect: camera rays as SIMD packets (Hittable::HitPacket), later
+//      bounces, which are incoherent, as a stream of single-ray queries;
+//   2. add the light of emitters hit, and sort the hits by MaterialType;
+//   3. shade each material type with its own kernel, calling Scatter without
+//      virtual dispatch and sampling the lights at Lambertian hits;
+//   4. compact the surviving paths.
+//
+// Paths keep their random key and reseed per bounce exactly like RayColor,
+// and sample radiance is summed in sample order, so the image is identical to
+// the scalar path.
+
+// Paths of one batch, as parallel arrays so each pass reads only what it needs.
+struct PathBatch {
+    std::vector<Ray> rays;
+    std::vector<Color> throughput;
+    std::vector<Real> bsdf_pdfs;  // of the last bounce, as in RayColor
+    std::vector<uint64_t> keys;   // RandomKey of the path's (seed, pixel, sample)
+    std::vector<int> slots;       // index of the path's sample in the radiance array
+    std::vector<HitRecord> recs;
+    std::unique_ptr<bool[]> hits;
+
+    size_t Size() const { return rays.size(); }
+
+    void Clear() {
+        rays.clear();
+        throughput.clear();
+        bsdf_pdfs.clear();
+        keys.clear();
+        slots.clear();
+    }
+
+    void Push(const Ray& r, const Color& t, uint64_t key, int slot) {
+        rays.push_back(r);
+        throughput.push_back(t);
+        bsdf_pdfs.push_back(0);
+        keys.push_back(key);
+        slots.push_back(slot);
+    }
+
+    // Moves path from into path to, for compaction in place.
+    void Move(size_t from, size_t to) {
+        rays[to] = rays[from];
+        throughput[to] = throughput[from];
+        bsdf_pdfs[to] = bsdf_pdfs[from];
+        keys[to] = keys[from];
+        slots[to] = slots[from];
+    }
+
+    void Resize(size_t size) {
+        rays.resize(size);
+        throughput.resize(size);
+        bsdf_pdfs.resize(size);
+        keys.resize(size);
+        slots.resize(size);
+    }
+};
+
+// Upper bound on the paths in flight per tile; more samples run in several batches.
+const int kWavefrontBatchSize = 4096;
+
+// Scatters the paths listed in indices off material type M. M::Scatter is
+// called non-virtually, so each kernel is one tight, inlinable loop; M =
+// Material is the virtual fallback for MaterialType::OTHER. Paths that die
+// have their slot set to -1. Light sampled at Lambertian hits is added to
+// radiance.
+template <typename M>
+void ShadeBatch(PathBatch& batch, const std::vector<int>& indices, int bounce, const RenderSettings& settings, Sampler& sampler,
+    const Tile& tile, int first_sample, int samples, const Hittable& world, std::vector<Color>& radiance) {
+    const LightSampler* lights = std::is_same<M, Lambertian>::value ? NextEventLights(settings) : nullptr;
+    int tile_width = tile.x1 - tile.x0;
+    for (int index : indices) {
+        const HitRecord& rec = batch.recs[index];
+        SeedRandomKey(batch.keys[index], settings.max_depth - bounce);
+        // The slot encodes the path's pixel and sample; see RenderTileWavefront.
+        int local = batch.slots[index] / samples;
+        sampler.StartPixelSample(tile.x0 + local % tile_width, tile.y1 - 1 - local / tile_width, first_sample + batch.slots[index] % samples);
+        sampler.StartVertex(bounce);
+
+        Ray scattered;
+        Color attenuation;
+        STATS_INC(scatter_calls[static_cast<int>(rec.mat_ptr->type_)]);
+        const M* material = static_cast<const M*>(rec.mat_ptr);
+        bool scatters;
+        if constexpr (std::is_same<M, Material>::value)
+            scatters = material->Scatter(batch.rays[index], rec, attenuation, scattered);
+        else
+            scatters = material->M::Scatter(batch.rays[index], rec, attenuation, scattered);
+        if (!scatters) {
+            STATS_INC(path_depth[std::min(bounce + 1, kStatsMaxDepth)]);
+            batch.slots[index] = -1;
+            continue;
+        }
+        batch.bsdf_pdfs[index] = 0;
+        if (lights) {
+            radiance[batch.slots[index]] += batch.throughput[index] * DirectLight(world, *lights, rec, attenuation);
+            batch.bsdf_pdfs[index] = Dot(rec.normal, UnitVector(scattered.Direction())) / Real(pi);
+        }
+        Color throughput = batch.throughput[index] * attenuation;
+
+        if (bounce + 1 >= settings.roulette_depth) {
+            Real survive = std::min(Real(0.95), std::max(throughput.x(), std::max(throughput.y(), throughput.z())));
+            if (sampler.Get1D() >= survive) {
+                STATS_INC(path_depth[std::min(bounce + 1, kStatsMaxDepth)]);
+                batch.slots[index] = -1;
+                continue;
+            }
+            throughput /= survive;
+        }
+
+        batch.throughput[index] = throughput;
+        batch.rays[index] = scattered;
+    }
+}
+
+uint64_t RenderTileWavefront(const Tile& tile, const RenderSettings& settings, const Hittable& world, const Camera& cam, Framebuffer& framebuffer) {
+    uint64_t rays = 0;
+    int tile_width = tile.x1 - tile.x0;
+    int tile_pixels = tile_width * (tile.y1 - tile.y0);
+    int samples_per_batch = std::max(1, std::min(settings.samples_per_pixel, kWavefrontBatchSize / std::max(1, tile_pixels)));
+
+    std::vector<Color> pixel_colors(tile_pixels, Color(0, 0, 0));
+    std::vector<Color> radiance;
+    std::vector<int> by_material[static_cast<int>(MaterialType::OTHER) + 1];
+    const LightSampler* lights = NextEventLights(settings);
+    PathBatch batch;
+    auto sampler = MakeSampler(settings.sampler, settings.seed, settings.samples_per_pixel);
+    SamplerScope sampler_scope(sampler.get());
+    batch.hits.reset(new bool[static_cast<size_t>(tile_pixels) * samples_per_batch]);
+    batch.recs.resize(static_cast<size_t>(tile_pixels) * samples_per_batch);
+
+    for (int s0 = 0; s0 < settings.samples_per_pixel; s0 += samples_per_batch) {
+        int samples = std::min(samples_per_batch, settings.samples_per_pixel - s0);
+        radiance.assign(static_cast<size_t>(tile_pixels) * samples, Color(0, 0, 0));
+
+        // Camera rays, in scanline order so neighbouring rays share packets.
+        batch.Clear();
+        for (int j = tile.y1 - 1; j >= tile.y0; --j) {
+            for (int i = tile.x0; i < tile.x1; ++i) {
+                uint64_t pixel = static_cast<uint64_t>(j) * settings.image_width + i;
+                int local = (tile.y1 - 1 - j) * tile_width + (i - tile.x0);
+                for (int s = 0; s < samples; ++s) {
+                    SeedRandom(settings.seed, pixel, s0 + s);
+                    sampler->StartPixelSample(i, j, s0 + s);
+                    Point2 jitter = sampler->Get2D();
+                    auto u = (i + jitter.x) / (settings.image_width - 1);
+                    auto v = (j + jitter.y) / (settings.image_height - 1);
+                    batch.Push(cam.GetRay(u, v), Color(1, 1, 1), ThreadRandomState().key, local * samples + s);
+                }
+            }
+        }
+
+        for (int bounce = 0; bounce < settings.max_depth && batch.Size() > 0; ++bounce) {
+            int count = static_cast<int>(batch.Size());
+            rays += count;
+
+            if (bounce == 0) {
+                world.HitPacket(batch.rays.data(), count, 0.001, infinity, batch.recs.data(), batch.hits.get());
+            } else {
+                for (int k = 0; k < count; ++k)
+                    batch.hits[k] = world.Hit(batch.rays[k], 0.001, infinity, batch.recs[k]);
+            }
+
+            for (auto& list : by_material)
+                list.clear();
+            for (int k = 0; k < count; ++k) {
+                if (!batch.hits[k]) {
+                    radiance[batch.slots[k]] += batch.throughput[k] * MissColor(settings, batch.rays[k]);
+                    STATS_INC(path_depth[std::min(bounce + 1, kStatsMaxDepth)]);
+                    batch.slots[k] = -1;
+                } else {
+                    const HitRecord& rec = batch.recs[k];
+                    Color emitted;
+                    if (EmittedMaterial(*rec.mat_ptr, rec, emitted))
+                        radiance[batch.slots[k]] += batch.throughput[k] * emitted * EmissionWeight(lights, batch.bsdf_pdfs[k], batch.rays[k], rec);
+                    by_material[static_cast<int>(rec.mat_ptr->type_)].push_back(k);
+                }
+            }
+
+            ShadeBatch<Lambertian>(batch, by_material[static_cast<int>(MaterialType::LAMBERTIAN)], bounce, settings, *sampler, tile, s0, samples, world, radiance);
+            ShadeBatch<Metal>(batch, by_material[static_cast<int>(MaterialType::METAL)], bounce, settings, *sampler, tile, s0, samples, world, radiance);
+            ShadeBatch<Dielectric>(batch, by_material[static_cast<int>(MaterialType::DIELECTRIC)], bounce, settings, *sampler, tile, s0, samples, world, radiance);
+            ShadeBatch<DiffuseLight>(batch, by_material[static_cast<int>(MaterialType::EMISSIVE)], bounce, settings, *sampler, tile, s0, samples, world, radiance);
+            ShadeBatch<Material>(batch, by_material[static_cast<int>(MaterialType::OTHER)], bounce, settings, *sampler, tile, s0, samples, world, radiance);
+
+            size_t alive = 0;
+            for (size_t k = 0; k < batch.Size(); ++k) {
+                if (batch.slots[k] < 0)
+                    continue;
+                if (alive != k)
+                    batch.Move(k, alive);
+                alive++;
+            }
+            batch.Resize(alive);
+        }
+        // Paths still alive after max_depth bounces gather no light.
+        STATS_ADD(path_depth[std::min(settings.max_depth, kStatsMaxDepth)], batch.Size());
+
+        // Sum in sample order, as RenderTile does.
+        for (int p = 0; p < tile_pixels; ++p) {
+            for (int s = 0; s < samples; ++s)
+                pixel_colors[p] += radiance[static_cast<size_t>(p) * samples + s];
+        }
+    }
+
+    for (int j = tile.y1 - 1; j >= tile.y0; --j) {
+        for (int i = tile.x0; i < tile.x1; ++i)
+            framebuffer.At(i, j) = pixel_colors[(tile.y1 - 1 - j) * tile_width + (i - tile.x0)];
+    }
+    return rays;
+}
+
+#endif // !WAVEFRONT_H